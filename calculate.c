@@ -43,93 +43,216 @@ BNF表示法消除左递归（将花括号提出来，和直接消除左递归
            | Num
 */
 
+/*
+calculate -e <expr> 按列批量计算：表达式里的变量按首次出现的顺序对应
+输入的各列（空白或逗号分隔），每行一组值，结果按行输出。
+
+<factor> ::= ( <expr> )
+           | Num
+           | Id
+*/
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/*
+每行先编译成后缀字节码再执行，编译结果按连续空白合并为一个空格后的文本缓存（LRU），
+重复出现的表达式不再解析。
+
+1 + 2 * 3  ==>  IMM 1 IMM 2 IMM 3 MUL ADD END
+
+输入按换行切成大块（标准输入每次 read 之后就处理已读到的整行），每块再切给多个线程，
+每个线程有自己的编译状态和缓存，结果写入各自的缓冲区后按顺序输出。
+某行无法解析时，先输出它之前各行的结果，再报告这一行并退出。
+*/
+
+enum
+{
+    Num = 128,
+    Id
+};
 
+// instructions of the compiled expressions
 enum
 {
-    Num
+    IMM = 1,
+    LOAD,   // LOAD n pushes column n
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    END
 };
 
-int expr();
-int factor();
-int term_tail(int lvalue);
+// number of compiled expressions kept, and of their hash buckets
+#define CACHE_SIZE    4096
+#define CACHE_BUCKETS (CACHE_SIZE * 2)
+
+// rows evaluated together by -e, and the most variables an expression may use
+#define BLOCK    1024
+#define MAX_VARS 64
+
+// input handed to the workers at once, the least worth another worker,
+// and the most workers
+#define CHUNK       (64 << 20)
+#define MIN_JOB     (64 << 10)
+#define MAX_THREADS 64
+
+typedef struct job
+{
+    char     *begin;   // whole lines of input
+    char     *end;
+    char     *out;     // their results
+    size_t    out_len;
+    size_t    out_cap;
+    char     *error;   // the line that does not parse, the job stops there
+    char      message[96];
+    pthread_t thread;
+} job;
+
+typedef struct entry
+{
+    char         *key;     // the line with runs of blanks made one space
+    unsigned int  hash;
+    int          *code;    // ends with END
+    struct entry *chain;   // next entry of the same bucket
+    struct entry *prev;    // the LRU list, most recently used first
+    struct entry *next;
+} entry;
+
+void expr();
+void factor();
+void term_tail();
+
+__thread char *src = NULL;
+__thread int   token;
+__thread int   token_val;
+
+__thread int *code     = NULL;   // code being compiled
+__thread int  code_len = 0;
+__thread int  code_cap = 0;
+
+__thread jmp_buf *on_error = NULL;   // where a worker goes on a malformed line
+__thread char     error[96];         // what is wrong with it
+
+char *var_names[MAX_VARS];   // variables of -e, in column order
+int   var_count = 0;
+int   batch     = 0;          // compiling the expression of -e
 
-char *src = NULL;
-int   token;
-int   token_val;
+// op applied lane by lane: a[i] = a[i] op b[i]
+void (*vector_op)(int op, int *a, int *b, int n);
+
+__thread entry *buckets[CACHE_BUCKETS];
+__thread entry *lru_head = NULL;
+__thread entry *lru_tail = NULL;
+__thread int    cache_count = 0;
+
+job jobs[MAX_THREADS];
+int threads = 1;
 
 void next();
 
+// the expression in error[] is malformed: the worker stops at its line, -e exits
+void fail()
+{
+    if (on_error) {
+        longjmp(*on_error, 1);
+    }
+    printf("%s\n", error);
+    exit(-1);
+}
+
 void match(int tk)
 {
     if (token != tk) {
-        printf("expected token: %d(%c), got: %d(%c)\n", tk, tk, token, token);
-        exit(-1);
+        snprintf(error, sizeof(error), "expected token: %d(%c), got: %d(%c)", tk, tk, token, token);
+        fail();
     }
     next();
 }
 
-int term()
+void emit(int word)
 {
-    int lvalue = factor();
-    return term_tail(lvalue);
+    if (code_len == code_cap) {
+        code_cap = code_cap ? code_cap * 2 : 64;
+        if (!(code = realloc(code, code_cap * sizeof(int)))) {
+            printf("could not realloc(%zu) for code\n", code_cap * sizeof(int));
+            exit(-1);
+        }
+    }
+    code[code_len++] = word;
+}
+
+void term()
+{
+    factor();
+    term_tail();
 }
-int expr_tail(int lvalue)
+void expr_tail()
 {
     if (token == '+') {
         match('+');
-        int value = lvalue + term();
-        return expr_tail(value);
+        term();
+        emit(ADD);
+        expr_tail();
     }
     else if (token == '-') {
         match('-');
-        int value = lvalue - term();
-        return expr_tail(value);
-    }
-    else {
-        return lvalue;
+        term();
+        emit(SUB);
+        expr_tail();
     }
 }
 
-int factor()
+void factor()
 {
-    int value;
     if (token == '(') {
         match('(');
-        value = expr();
+        expr();
         match(')');
-        return value;
+    }
+    else if (token == Id) {
+        emit(LOAD);
+        emit(token_val);
+        match(Id);
     }
     else {
-        value = token_val;
+        emit(IMM);
+        emit(token_val);
         match(Num);
     }
-    return value;
 }
 
-int term_tail(int lvalue)
+void term_tail()
 {
     if (token == '*') {
         match('*');
-        int value = lvalue * factor();
-        return term_tail(value);
+        factor();
+        emit(MUL);
+        term_tail();
     }
     else if (token == '/') {
         match('/');
-        int value = lvalue / factor();
-        return term_tail(value);
-    }
-    else {
-        return lvalue;
+        factor();
+        emit(DIV);
+        term_tail();
     }
-    return 0;
 }
 
-int expr()
+void expr()
 {
-    int lvalue = term();
-    return expr_tail(lvalue);
+    term();
+    expr_tail();
 }
 
 void next()
@@ -147,17 +270,571 @@ void next()
         }
         return;
     }
+    if ((token >= 'a' && token <= 'z') || (token >= 'A' && token <= 'Z') || token == '_') {
+        char *name = src - 1;
+        int   len;
+
+        // the variables are shared, only -e fills them, before any thread runs
+        if (!batch) {
+            snprintf(error, sizeof(error), "variables are only allowed with -e");
+            fail();
+        }
+
+        while ((*src >= 'a' && *src <= 'z') || (*src >= 'A' && *src <= 'Z') || (*src >= '0' && *src <= '9') || *src == '_') {
+            src++;
+        }
+        len = src - name;
+        for (token_val = 0; token_val < var_count; token_val++) {
+            if (!strncmp(var_names[token_val], name, len) && !var_names[token_val][len]) {
+                break;
+            }
+        }
+        if (token_val == var_count) {
+            if (var_count == MAX_VARS) {
+                printf("more than %d variables\n", MAX_VARS);
+                exit(-1);
+            }
+            var_names[var_count++] = strndup(name, len);
+        }
+        token = Id;
+    }
 }
 
-int main(int argc, char *argv[])
+// compile the expression in text, returns a copy of its code
+int *compile(char *text)
+{
+    int *copy;
+
+    code_len = 0;
+    src      = text;
+    next();
+    expr();
+    emit(END);
+    if (!(copy = malloc(code_len * sizeof(int)))) {
+        printf("could not malloc(%zu) for code\n", code_len * sizeof(int));
+        exit(-1);
+    }
+    return memcpy(copy, code, code_len * sizeof(int));
+}
+
+int run(int *pc)
+{
+    static __thread int *stack     = NULL;
+    static __thread int  stack_cap = 0;
+    int        *sp;
+    int         op;
+
+    // every value is pushed by an IMM, so the code length bounds the depth
+    if (stack_cap < code_len) {
+        stack_cap = code_len;
+        if (!(stack = realloc(stack, stack_cap * sizeof(int)))) {
+            printf("could not realloc(%zu) for stack\n", stack_cap * sizeof(int));
+            exit(-1);
+        }
+    }
+    sp = stack;
+    while ((op = *pc++) != END) {
+        if (op == IMM) {
+            *sp++ = *pc++;
+        }
+        else {
+            sp--;
+            if (op == ADD) {
+                sp[-1] = sp[-1] + *sp;
+            }
+            else if (op == SUB) {
+                sp[-1] = sp[-1] - *sp;
+            }
+            else if (op == MUL) {
+                sp[-1] = sp[-1] * *sp;
+            }
+            else {
+                sp[-1] = sp[-1] / *sp;
+            }
+        }
+    }
+    return sp[-1];
+}
+
+void scalar_op(int op, int *a, int *b, int n)
+{
+    int i;
+
+    if (op == ADD) {
+        for (i = 0; i < n; i++) {
+            a[i] = a[i] + b[i];
+        }
+    }
+    else if (op == SUB) {
+        for (i = 0; i < n; i++) {
+            a[i] = a[i] - b[i];
+        }
+    }
+    else if (op == MUL) {
+        for (i = 0; i < n; i++) {
+            a[i] = a[i] * b[i];
+        }
+    }
+    else {
+        for (i = 0; i < n; i++) {
+            a[i] = a[i] / b[i];
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// eight lanes at a time; AVX2 has no integer division, so DIV stays scalar
+__attribute__((target("avx2"))) void avx2_op(int op, int *a, int *b, int n)
+{
+    __m256i x, y;
+    int     i = 0;
+
+    if (op != DIV) {
+        for (; i + 8 <= n; i += 8) {
+            x = _mm256_loadu_si256((__m256i *)(a + i));
+            y = _mm256_loadu_si256((__m256i *)(b + i));
+            if (op == ADD) {
+                x = _mm256_add_epi32(x, y);
+            }
+            else if (op == SUB) {
+                x = _mm256_sub_epi32(x, y);
+            }
+            else {
+                x = _mm256_mullo_epi32(x, y);
+            }
+            _mm256_storeu_si256((__m256i *)(a + i), x);
+        }
+    }
+    scalar_op(op, a + i, b + i, n - i);
+}
+#endif
+
+// evaluate the code for n rows of columns, returns the results
+int *run_block(int *pc, int **columns, int n)
+{
+    static int *stack     = NULL;
+    static int  stack_cap = 0;
+    int        *sp;
+    int         op, i;
+
+    if (stack_cap < code_len * BLOCK) {
+        stack_cap = code_len * BLOCK;
+        if (!(stack = realloc(stack, stack_cap * sizeof(int)))) {
+            printf("could not realloc(%zu) for stack\n", stack_cap * sizeof(int));
+            exit(-1);
+        }
+    }
+    sp = stack;
+    while ((op = *pc++) != END) {
+        if (op == IMM) {
+            for (i = 0; i < n; i++) {
+                sp[i] = *pc;
+            }
+            pc++;
+            sp += BLOCK;
+        }
+        else if (op == LOAD) {
+            memcpy(sp, columns[*pc++], n * sizeof(int));
+            sp += BLOCK;
+        }
+        else {
+            sp -= BLOCK;
+            vector_op(op, sp - BLOCK, sp, n);
+        }
+    }
+    return sp - BLOCK;
+}
+
+// -e: read rows of values and print expr evaluated on each
+int run_columns(char *expr)
 {
+    int    *pc;
+    int    *columns[MAX_VARS];
+    int    *results;
+    int     rows = 0;
+    int     line = 0;
+    int     i, v;
     char   *lineptr = NULL;
-    size_t  linecap;
-    ssize_t linelen;
-    while ((linelen = getline(&lineptr, &linecap, stdin))) {
-        src = lineptr;
-        next();
-        printf("%d\n", expr());
-    }
-    return EXIT_SUCCESS;
+    size_t  linecap = 0;
+    char   *p, *end;
+
+    vector_op = scalar_op;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        vector_op = avx2_op;
+    }
+#endif
+
+    batch = 1;
+    pc    = compile(expr);
+    if (token) {
+        printf("unexpected token: %d(%c)\n", token, token);
+        return -1;
+    }
+    for (v = 0; v < var_count; v++) {
+        if (!(columns[v] = malloc(BLOCK * sizeof(int)))) {
+            printf("could not malloc(%zu) for columns\n", BLOCK * sizeof(int));
+            return -1;
+        }
+    }
+
+    while (1) {
+        if (rows == BLOCK || getline(&lineptr, &linecap, stdin) <= 0) {
+            if (rows) {
+                results = run_block(pc, columns, rows);
+                for (i = 0; i < rows; i++) {
+                    printf("%d\n", results[i]);
+                }
+            }
+            if (rows < BLOCK) {
+                break;
+            }
+            rows = 0;
+            continue;
+        }
+        line++;
+        p = lineptr;
+        for (v = 0; v < var_count; v++) {
+            while (*p == ' ' || *p == '\t' || *p == ',') {
+                p++;
+            }
+            columns[v][rows] = strtol(p, &end, 10);
+            if (end == p) {
+                printf("%d: expected %d values\n", line, var_count);
+                return -1;
+            }
+            p = end;
+        }
+        rows++;
+    }
+    return 0;
+}
+
+void lru_unlink(entry *e)
+{
+    if (e->prev) {
+        e->prev->next = e->next;
+    }
+    else {
+        lru_head = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    }
+    else {
+        lru_tail = e->prev;
+    }
+}
+
+void lru_push(entry *e)
+{
+    e->prev = NULL;
+    e->next = lru_head;
+    if (lru_head) {
+        lru_head->prev = e;
+    }
+    else {
+        lru_tail = e;
+    }
+    lru_head = e;
+}
+
+// drop the least recently used expression
+void evict()
+{
+    entry  *e = lru_tail;
+    entry **p = &buckets[e->hash % CACHE_BUCKETS];
+
+    while (*p != e) {
+        p = &(*p)->chain;
+    }
+    *p = e->chain;
+    lru_unlink(e);
+    free(e->key);
+    free(e->code);
+    free(e);
+    cache_count--;
+}
+
+// the code of the expression in [line, end), compiled on the first use.
+// the key is the line with every run of blanks made one space, which still
+// separates the tokens, so compiling the key means the same as the line
+int *lookup(char *line, char *end)
+{
+    static __thread char  *key    = NULL;
+    static __thread size_t keycap = 0;
+    unsigned int hash = 2166136261u;
+    char        *s;
+    entry       *e;
+    size_t       n = 0;
+
+    if (keycap < (size_t)(end - line) + 1) {
+        keycap = (size_t)(end - line) + 1;
+        if (!(key = realloc(key, keycap))) {
+            printf("could not realloc(%zu) for line\n", keycap);
+            exit(-1);
+        }
+    }
+    while (line < end && (*line == ' ' || *line == '\t')) {
+        line++;
+    }
+    for (; line < end; line++) {
+        if (*line != ' ' && *line != '\t') {
+            key[n++] = *line;
+        }
+        else if (line + 1 < end && line[1] != ' ' && line[1] != '\t') {
+            key[n++] = ' ';
+        }
+    }
+    key[n] = 0;
+
+    for (s = key; *s; s++) {
+        hash = (hash ^ (unsigned char)*s) * 16777619u;
+    }
+    for (e = buckets[hash % CACHE_BUCKETS]; e; e = e->chain) {
+        if (e->hash == hash && !strcmp(e->key, key)) {
+            if (e != lru_head) {
+                lru_unlink(e);
+                lru_push(e);
+            }
+            return e->code;
+        }
+    }
+
+    if (cache_count == CACHE_SIZE) {
+        evict();
+    }
+    if (!(e = malloc(sizeof(entry))) || !(e->key = strdup(key))) {
+        printf("could not malloc(%zu) for cache\n", sizeof(entry));
+        exit(-1);
+    }
+    e->hash = hash;
+    e->code = compile(key);
+    e->chain = buckets[hash % CACHE_BUCKETS];
+    buckets[hash % CACHE_BUCKETS] = e;
+    lru_push(e);
+    cache_count++;
+    return e->code;
+}
+
+// evaluate the lines of a job into its output
+void *worker(void *arg)
+{
+    job    *j = arg;
+    char   *p = j->begin;
+    char   *volatile line = NULL;   // still read after the longjmp of fail()
+    char    digits[12];
+    int     value, n;
+    unsigned int magnitude;
+    jmp_buf malformed;
+
+    j->out_len = 0;
+    j->error   = NULL;
+    on_error   = &malformed;
+    if (setjmp(malformed)) {
+        // the results so far stay in out, process() prints them first
+        on_error = NULL;
+        j->error = line;
+        strcpy(j->message, error);
+        return NULL;
+    }
+    while (p < j->end) {
+        line = p;
+        while (p < j->end && *p != '\n') {
+            p++;
+        }
+        value = run(lookup(line, p));
+        p++;
+
+        if (j->out_cap < j->out_len + sizeof(digits) + 1) {
+            j->out_cap = j->out_cap ? j->out_cap * 2 : 1 << 16;
+            if (!(j->out = realloc(j->out, j->out_cap))) {
+                printf("could not realloc(%zu) for output\n", j->out_cap);
+                exit(-1);
+            }
+        }
+        // digits backwards from the end of digits[], then the sign
+        magnitude = value < 0 ? -(unsigned int)value : (unsigned int)value;
+        n = sizeof(digits);
+        do {
+            digits[--n] = '0' + magnitude % 10;
+            magnitude /= 10;
+        } while (magnitude);
+        if (value < 0) {
+            digits[--n] = '-';
+        }
+        memcpy(j->out + j->out_len, digits + n, sizeof(digits) - n);
+        j->out_len += sizeof(digits) - n;
+        j->out[j->out_len++] = '\n';
+    }
+    on_error = NULL;
+    return NULL;
+}
+
+void write_all(char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len) {
+        if ((n = write(1, buf, len)) <= 0) {
+            printf("could not write results\n");
+            exit(-1);
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+// evaluate the lines of [begin, end) on the workers, print in order
+void process(char *begin, char *end)
+{
+    char *p    = begin;
+    int   n    = 0;
+    int   step = (end - begin) / threads;
+    int   i;
+
+    if (step < MIN_JOB) {
+        step = MIN_JOB;
+    }
+    while (p < end && n < threads) {
+        jobs[n].begin = p;
+        p += step;
+        if (p >= end || n == threads - 1) {
+            p = end;
+        }
+        else {
+            while (p < end && *p++ != '\n') {
+            }
+        }
+        jobs[n].end = p;
+        n++;
+    }
+
+    for (i = 1; i < n; i++) {
+        if (pthread_create(&jobs[i].thread, NULL, worker, &jobs[i])) {
+            printf("could not create thread\n");
+            exit(-1);
+        }
+    }
+    if (n) {
+        worker(&jobs[0]);
+    }
+    for (i = 0; i < n; i++) {
+        if (i) {
+            pthread_join(jobs[i].thread, NULL);
+        }
+        write_all(jobs[i].out, jobs[i].out_len);
+        if (jobs[i].error) {
+            for (p = jobs[i].error; p < jobs[i].end && *p != '\n'; p++) {
+            }
+            printf("%.*s: %s\n", (int)(p - jobs[i].error), jobs[i].error, jobs[i].message);
+            exit(-1);
+        }
+    }
+}
+
+// the input in chunks of whole lines
+int run_lines(char *file)
+{
+    char   *buf;
+    size_t  cap = CHUNK;
+    size_t  len = 0;
+    ssize_t n   = 1;
+    char   *p, *last;
+    struct stat st;
+    int     fd = 0;
+
+    if (file) {
+        if ((fd = open(file, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+            printf("could not open(%s)\n", file);
+            return -1;
+        }
+        if (!st.st_size) {
+            return 0;
+        }
+        if ((buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+            printf("could not mmap(%s)\n", file);
+            return -1;
+        }
+        madvise(buf, st.st_size, MADV_SEQUENTIAL);
+        for (p = buf; p < buf + st.st_size; p = last) {
+            last = p + CHUNK < buf + st.st_size ? p + CHUNK : buf + st.st_size;
+            while (last < buf + st.st_size && *last++ != '\n') {
+            }
+            process(p, last);
+        }
+        munmap(buf, st.st_size);
+        close(fd);
+        return 0;
+    }
+
+    if (!(buf = malloc(cap))) {
+        printf("could not malloc(%zu) for input\n", cap);
+        return -1;
+    }
+    while (n > 0) {
+        // evaluate whatever whole lines each read brings, so that a pipe is
+        // answered line by line, and large reads still fill the workers
+        if ((n = read(fd, buf + len, cap - len)) < 0) {
+            printf("could not read input\n");
+            return -1;
+        }
+        len += n;
+
+        // hand over the whole lines, keep the partial one for the next read,
+        // which has no newline, so only the new bytes are searched
+        last = buf + len;
+        if (n > 0) {
+            while (last > buf + len - n && last[-1] != '\n') {
+                last--;
+            }
+            if (last == buf + len - n) {
+                if (len < cap) {
+                    continue;
+                }
+                cap *= 2;
+                if (!(buf = realloc(buf, cap))) {
+                    printf("could not realloc(%zu) for input\n", cap);
+                    return -1;
+                }
+                continue;
+            }
+        }
+        process(buf, last);
+        len = buf + len - last;
+        memmove(buf, last, len);
+    }
+    free(buf);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char *file = NULL;
+    int   i;
+
+    if (argc == 3 && !strcmp(argv[1], "-e")) {
+        return run_columns(argv[2]);
+    }
+
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        }
+        else if (!file && argv[i][0] != '-') {
+            file = argv[i];
+        }
+        else {
+            printf("usage: calculate [-j threads] [file]\n       calculate -e expr\n");
+            return -1;
+        }
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+    return run_lines(file);
 }
@@ -0,0 +1,51 @@
+// indexing, and multiplication, division and shifts by constants
+#include <stdio.h>
+#include <stdlib.h>
+
+int main()
+{
+    int *a, *p, *q, **pp;
+    char *s, *t;
+    int i, n, x;
+
+    a = malloc(16 * sizeof(int));
+    i = 0;
+    while (i < 16) { a[i] = i * i; i++; }
+    a[3] = a[4] + a[a[2]];
+    a[5]++;
+    ++a[6];
+    a[7]--;
+    p = &a[8];
+    *p = -1;
+    q = a + 10;
+    q[1] = 99;
+    p = q - 2;
+    printf("%d %d %d %d ", a[3], a[5], a[6], a[7]);
+    printf("%d %d %d\n", a[8], a[11], *p);
+    printf("diff %d %d\n", q - a, a - q);
+
+    s = malloc(8);
+    i = 0;
+    while (i < 7) { s[i] = 'a' + i; i++; }
+    s[7] = 0;
+    s[2] = s[1] = 'Z';
+    s[3]++;
+    t = &s[4];
+    *t = '_';
+    printf("%s %d\n", s, (s[0] = 300) + 0);
+
+    pp = malloc(2 * sizeof(int *));
+    pp[0] = a; pp[1] = a + 2;
+    printf("pp %d %d\n", pp[1][2], *pp[0]);
+
+    x = -37;
+    while (x <= 37) {
+        printf("%d: %d %d %d %d ", x, x * 8, x * 6, x / 4, x / 7);
+        printf("%d %d %d %d\n", x / 1, x % 4, x % 5, x >> 2);
+        printf("  %d %d %d\n", x << 3, x / -4, x * -2);
+        x = x + 13;
+    }
+    n = 0;
+    printf("%d\n", n);
+    return 0;
+}
@@ -0,0 +1,16 @@
+// benchmark: a nested loop around a branch
+#include <stdio.h>
+#include <stdlib.h>
+
+int main()
+{
+    int i, j, s;
+    s = 0; i = 0;
+    while (i < 3000) {
+        j = 0;
+        while (j < 1000) { if (j != i) s = s + j; j++; }
+        i++;
+    }
+    printf("%d\n", s);
+    return 0;
+}
@@ -0,0 +1,14 @@
+// benchmark: a nested loop over an array, with division
+#include <stdio.h>
+#include <stdlib.h>
+
+int main()
+{
+    int *a, i, j, s;
+    a = malloc(1000 * sizeof(int));
+    i = 0; while (i < 1000) { a[i] = i; i++; }
+    s = 0; j = 0;
+    while (j < 2000) { i = 0; while (i < 1000) { s = s + a[i] / 4; a[i] = a[i] * 2 / 2; i++; } j++; }
+    printf("%d\n", s);
+    return 0;
+}
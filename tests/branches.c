@@ -0,0 +1,74 @@
+// comparisons fused with the branches and the values they produce
+#include <stdio.h>
+
+int cmps(int a, int b)
+{
+    int r;
+    r = 0;
+    if (a == b) r = r | 1;
+    if (a != b) r = r | 2;
+    if (a < b) r = r | 4;
+    if (a > b) r = r | 8;
+    if (a <= b) r = r | 16;
+    if (a >= b) r = r | 32;
+    if (a == 3) r = r | 64;
+    if (a != 3) r = r | 128;
+    if (a < 3) r = r | 256;
+    if (a > 3) r = r | 512;
+    if (a <= 3) r = r | 1024;
+    if (a >= 3) r = r | 2048;
+    if (a > -2) r = r | 4096;
+    return r;
+}
+
+int vals(int a, int b)
+{
+    int v;
+    v = (a < b && b < 10);
+    v = v * 2 + (a < 3 || b > 5);
+    v = v * 2 + (a == b || a < 0);
+    v = v * 2 + (a > 2 && b != a);
+    v = v * 2 + (a >= b ? 1 : 0);
+    v = v * 2 + (a < 5 ? (b < 5 ? 1 : 0) : 0);
+    v = v * 2 + (a < b);
+    v = v * 2 + ((a < 4) == (b < 4));
+    return v;
+}
+
+int main()
+{
+    int i, j, n;
+    char *s;
+
+    i = -3;
+    while (i <= 5) {
+        j = -3;
+        while (j <= 5) {
+            printf("%d %d: %d %d\n", i, j, cmps(i, j), vals(i, j));
+            j = j + 4;
+        }
+        i++;
+    }
+
+    n = 0;
+    for (i = 0; i < 10; i++)
+        for (j = 10; j > i; j--)
+            if (i != 3 && j >= 5) n++;
+    printf("n %d\n", n);
+
+    i = 0;
+    do i = i + 3; while (i < 20);
+    printf("do %d\n", i);
+
+    s = "hello world"; n = 0;
+    while (*s != 0) {
+        if (*s == 'o' || *s == 'l') n++;
+        s++;
+    }
+    printf("chars %d\n", n);
+
+    i = 0;
+    while (i < 3 && (i == 0 || i != 5)) i++;
+    printf("and %d\n", i);
+    return 0;
+}
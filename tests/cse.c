@@ -0,0 +1,47 @@
+// common subexpressions and loop invariants for -O2
+#include <stdio.h>
+#include <stdlib.h>
+
+int *g;
+
+int sum(int *a, int n, int k)
+{
+    int i, s;
+    char *c;
+    c = malloc(n);
+    i = 0;
+    s = 0;
+    while (i < n * 2 - k) {
+        a[i] = a[i] + k * 3;
+        c[i / 2] = c[i / 2] + 1;
+        s = s + a[i] + (n * 2 - k);
+        i++;
+    }
+    i = 0;
+    while (i < n) {
+        g[i + k] = g[i + k] * 2 + 1;
+        i++;
+    }
+    return s + c[3];
+}
+
+int main()
+{
+    int *a, i, j, t;
+    a = malloc(4096 * sizeof(int));
+    g = malloc(4096 * sizeof(int));
+    i = 0;
+    while (i < 4096) {
+        a[i] = i;
+        g[i] = i;
+        i++;
+    }
+    t = 0;
+    j = 0;
+    while (j < 300) {
+        t = t + sum(a, 1000, j % 7);
+        j++;
+    }
+    printf("%d %d\n", t, g[50]);
+    return 0;
+}
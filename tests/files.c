@@ -0,0 +1,39 @@
+// open, read and mmap of a file, run from the top of the tree
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+int main()
+{
+    int fd, n, total, lines;
+    char *buf, *p, *end;
+    buf = malloc(16);
+    fd = open("tests/files.c", 0);
+    total = 0;
+    lines = 0;
+    while ((n = read(fd, buf, 3)) > 0) {
+        total = total + n;
+        p = buf;
+        while (p < buf + n) {
+            if (*p == '\n') lines++;
+            p++;
+        }
+    }
+    close(fd);
+    printf("read %d bytes, %d lines\n", total, lines);
+
+    fd = open("tests/files.c", 0);
+    p = mmap(0, total, 1, 2, fd, 0);
+    end = p + total;
+    lines = 0;
+    while (p < end && (p = memchr(p, '\n', end - p))) {
+        lines++;
+        p++;
+    }
+    printf("mapped %d lines\n", lines);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,23 @@
+// functions that --lazy skips, with braces in strings and comments
+#include <stdio.h>
+
+// helpers, most never called
+int unused1(int a) { char *s; s = "never { compiled }"; return a + '}'; }
+# define NOT_A_BRACE }
+int square(int x)
+{
+    // a comment with a brace }
+    return x * x;
+}
+int unused2() { return unused1(3); }
+int fact(int n) { if (n <= 1) return 1; return n * fact(n - 1); }
+int main()
+{
+    int i;
+    i = 0;
+    while (i < 5) {
+        printf("%d %d %s\n", square(i), fact(i), "}{");
+        i = i + 1;
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+// a function promoted by --tiered keeps the string literals it started with
+#include <stdio.h>
+#include <stdlib.h>
+
+char *first;
+
+int f(int i)
+{
+    char *s;
+    s = "a";
+    if (!first) {
+        first = s;
+    }
+    if (s != first) {
+        printf("literal moved at %d\n", i);
+        exit(1);
+    }
+    return *s;
+}
+
+int main()
+{
+    int i, sum;
+    i = 0;
+    sum = 0;
+    while (i < 3000) {
+        sum = sum + f(i);
+        i = i + 1;
+    }
+    printf("%d\n", sum);
+    return 0;
+}
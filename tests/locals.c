@@ -0,0 +1,66 @@
+// locals, increments and pointers to them
+#include <stdio.h>
+
+void swap(int *a, int *b)
+{
+    int t;
+    t = *a;
+    *a = *b;
+    *b = t;
+}
+
+int fact(int n)
+{
+    int r;
+    r = n <= 1 ? 1 : n * fact(n - 1);
+    return r;
+}
+
+int main()
+{
+    int i, j, k, *p, *arr;
+    char c, *s;
+
+    i = 3; j = 9;
+    swap(&i, &j);
+    printf("swap %d %d\n", i, j);
+
+    i = j = k = 5;
+    printf("chain %d %d %d\n", i, j, k);
+
+    i = 10;
+    j = i++;
+    j = j * 100 + ++i;
+    k = i--;
+    k = k * 100 + --i;
+    printf("inc %d %d %d\n", i, j, k);
+
+    arr = malloc(4 * sizeof(int));
+    arr[0] = 1; arr[1] = 2; arr[2] = 3; arr[3] = 4;
+    p = arr;
+    p++;
+    ++p;
+    printf("ptr %d", *p);
+    p--;
+    printf(" %d", *p++);
+    printf(" %d\n", *--p);
+
+    p = &i;
+    *p = 77;
+    printf("addr %d %d\n", i, *&j);
+
+    c = 'a';
+    c++;
+    ++c;
+    s = "xyz";
+    s++;
+    printf("char %c %c\n", c, *s);
+
+    k = 0;
+    for (i = 0; i < 10; i++) k = k + fact(i);
+    printf("fact %d %d\n", k, fact(10));
+    i = 5;
+    i = i - 1 + i;
+    printf("self %d\n", i);
+    return 0;
+}
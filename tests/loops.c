@@ -0,0 +1,74 @@
+// for, do and while loops, continue and break
+#include <stdio.h>
+
+int sum_for(int n)
+{
+    int i, s;
+    s = 0;
+    for (i = 0; i < n; i++) {
+        if (i % 3 == 0) continue;
+        if (i > 50) break;
+        s = s + i;
+    }
+    return s;
+}
+
+int sum_do(int n)
+{
+    int s;
+    s = 0;
+    do {
+        n--;
+        if (n == 4) continue;
+        s = s + n;
+    } while (n > 0);
+    return s;
+}
+
+int main()
+{
+    int i, j, k, n;
+    char *p;
+
+    printf("%d %d %d\n", sum_for(10), sum_for(100), sum_for(0));
+    printf("%d %d\n", sum_do(10), sum_do(0));
+
+    i = 0; k = 0;
+    while (i < 20) {
+        i++;
+        if (i & 1) continue;
+        switch (i) {
+        case 4: continue;
+        case 16: break;
+        default: k = k + i;
+        }
+        if (i == 18) break;
+    }
+    printf("while %d %d\n", i, k);
+
+    n = 0;
+    for (i = 0; i < 5; i++)
+        for (j = 0; j < 5; j++) {
+            if (j == i) continue;
+            if (j > 3) break;
+            n = n * 3 + j;
+            n = n % 100003;
+        }
+    printf("nested %d\n", n);
+
+    k = 0;
+    for (;;) { k++; if (k == 7) break; }
+    i = 0;
+    for (; i < 3;) i++;
+    printf("empty %d %d\n", k, i);
+
+    p = "abcdefgh"; n = 0;
+    while (*p
+           != 'f') { p++; n++; }
+    printf("multi %d\n", n);
+    i = 0;
+    while (i < 0) i++;
+    do i++; while (0);
+    printf("zero %d\n", i);
+    return 0;
+}
@@ -0,0 +1,11 @@
+// operands of every size in the byte encoding of --compact
+#include <stdio.h>
+int main()
+{
+    int a, b;
+    a = -1000000000;
+    b = 1000000000;
+    printf("%d %d %d %d %d\n", a, b, -64, -65, 8191);
+    printf("%d %d %d\n", -8192, -8193, 123456789);
+    return 0;
+}
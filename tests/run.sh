@@ -0,0 +1,77 @@
+#!/bin/sh
+# run every program of tests/ in each mode of xc, and the inputs of tests/
+# through calculate, and compare the output with the .expect next to them,
+# which for the programs is the output of their native build
+#
+#   sh tests/run.sh xc calculate [cc]
+#
+# from the top of the tree; cc compiles the C of --emit-c and needs -m32
+# when xc is built with -m32
+xc=$1
+calculate=$2
+cc=${3:-cc}
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+tests=0
+failed=0
+
+# compare the output in $tmp/out with the file $2, $1 names the test
+check()
+{
+    tests=$((tests + 1))
+    if ! cmp -s "$tmp/out" "$2"; then
+        echo "FAIL: $1"
+        failed=$((failed + 1))
+    fi
+}
+
+for t in tests/*.c; do
+    expect=${t%.c}.expect
+    for mode in "" -O2 --lazy "--lazy -O2" --tiered "--tiered --lazy" --compact "--compact -O2" \
+                "--profile $tmp/profile" "--trace $tmp/trace" "--write-profile $tmp/pgo"; do
+        $xc $mode $t > $tmp/out 2>&1
+        check "xc $mode $t" $expect
+    done
+    $xc --trace-decode $tmp/trace > $tmp/decoded || echo "FAIL: xc --trace-decode of $t"
+    $xc --use-profile $tmp/pgo $t > $tmp/out 2>&1
+    check "xc --use-profile $t" $expect
+    $xc --use-profile $tmp/pgo -O2 $t > $tmp/out 2>&1
+    check "xc --use-profile -O2 $t" $expect
+
+    rm -f $tmp/emit
+    $xc --emit-c $t > $tmp/emit.c && $cc -w -o $tmp/emit $tmp/emit.c && $tmp/emit > $tmp/out 2>&1
+    check "xc --emit-c $t" $expect
+
+    # xc running itself, too slow for the benchmarks
+    case $t in
+    tests/bench*)
+        ;;
+    *)
+        $xc xc.c $t > $tmp/out 2>&1
+        cp $expect $tmp/expect
+        printf 'exit(0)' >> $tmp/expect   # the exit of the outer xc
+        check "xc xc.c $t" $tmp/expect
+        ;;
+    esac
+done
+
+for mode in "" "-j 4"; do
+    $calculate $mode < tests/lines.txt > $tmp/out 2>&1
+    check "calculate $mode < tests/lines.txt" tests/lines.expect
+    $calculate $mode tests/lines.txt > $tmp/out 2>&1
+    check "calculate $mode tests/lines.txt" tests/lines.expect
+    # the lines before the malformed one are printed first
+    $calculate $mode < tests/malformed.txt > $tmp/out 2>&1 && echo "FAIL: calculate $mode accepted tests/malformed.txt"
+    check "calculate $mode < tests/malformed.txt" tests/malformed.expect
+done
+$calculate -e "x * (y + 3) - x / z + y * y * z" < tests/columns.txt > $tmp/out 2>&1
+check "calculate -e < tests/columns.txt" tests/columns.expect
+
+# a line is answered before the next one is written
+{ echo 1+2; sleep 1; cp $tmp/out $tmp/early; echo 3+4; } | $calculate > $tmp/out
+echo 3 > $tmp/expect
+cp $tmp/early $tmp/out
+check "calculate answers each line of a pipe" $tmp/expect
+
+echo "$tests tests, $failed failed"
+[ $failed = 0 ]
@@ -0,0 +1,22 @@
+// the string and memory builtins
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main()
+{
+    char *a, *b, *p;
+    a = malloc(64);
+    b = malloc(64);
+    memset(a, 0, 64);
+    memcpy(a, "hello, world", 13);
+    printf("%s %d\n", a, strlen(a));
+    memmove(a + 2, a, 5);
+    printf("%s\n", a);
+    p = memchr(a, 'w', strlen(a));
+    printf("%s %d\n", p, p - a);
+    printf("%d %d %d\n", strcmp("abc", "abd") < 0, strcmp("b", "a") > 0, strcmp("x", "x"));
+    memcpy(b, a, 64);
+    printf("%d\n", memcmp(a, b, 64));
+    return 0;
+}
@@ -0,0 +1,58 @@
+// switch, dense and sparse, nested and empty
+#include <stdio.h>
+
+enum { RED, GREEN = 5, BLUE };
+int dense(int x)
+{
+    int r;
+    r = 0;
+    switch (x) {
+    case 0: r = 100; break;
+    case 1:
+    case 2: r = 12; break;
+    case 3: r = 3;
+    case 4: r = r + 4; break;
+    case -1: r = -1; break;
+    default: r = 999;
+    }
+    return r;
+}
+int sparse(int x)
+{
+    switch (x) {
+    case 1000: return 1;
+    case -70000: return 2;
+    case 'a': return 3;
+    case BLUE: return 4;
+    case 77: return 5;
+    }
+    return 0;
+}
+int nested(int a, int b)
+{
+    int n;
+    n = 0;
+    while (a > 0) {
+        switch (a % 3) {
+        case 0:
+            switch (b) { case 1: n = n + 10; break; default: n = n + 20; }
+            break;
+        case 1: n = n + 1; break;
+        default: if (a == 5) break; n = n + 100;
+        }
+        a--;
+        if (n > 1000) break;
+    }
+    return n;
+}
+int empty(int x) { switch (x) { } switch (x) { default: return 7; } return 0; }
+int main()
+{
+    int i;
+    i = -2;
+    while (i < 7) { printf("%d:%d ", i, dense(i)); i++; }
+    printf("\n%d %d %d %d %d ", sparse(1000), sparse(-70000), sparse(97), sparse(6), sparse(77));
+    printf("%d\n", sparse(5));
+    printf("%d %d %d\n", nested(9, 1), nested(9, 2), empty(3));
+    return 0;
+}
@@ -0,0 +1,33 @@
+// hot functions and loops that --tiered promotes
+#include <stdio.h>
+
+int fib(int n)
+{
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+int sum(int *a, int n)
+{
+    int i, s;
+    s = 0;
+    for (i = 0; i < n; i++) {
+        if (a[i] < 0) continue;
+        s = s + a[i];
+    }
+    return s;
+}
+
+int main()
+{
+    int *a, i, t;
+    a = malloc(100 * sizeof(int));
+    i = 0;
+    while (i < 100) { a[i] = (i % 7) - 2; i++; }
+    printf("fib %d\n", fib(20));
+    t = 0;
+    i = 0;
+    do { t = t + sum(a, i); i++; } while (i < 100);
+    printf("sum %d\n", t);
+    return 0;
+}
@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 // default size of text/data/stack
@@ -10,6 +12,7 @@ int poolsize;
 // read source code
 int   token;           // current token
 char *src, *old_src;   // pointer to source code string
+char *src_end;         // end of source code string
 int   line;            // line number
 
 // runtime struction
@@ -29,29 +32,161 @@ int *pc,   // program counter
 // instructions
 enum
 {
-    LEA, IMM, JMP, CALL, JZ, JNZ, ENT, ADJ, LEV, LI, LC, SI, SC, PUSH,
+    LEA, IMM, LL, SL, INCL, JMP, CALL, JZ, JNZ,
+    JEQ, JNE, JLT, JGT, JLE, JGE, JEQI, JNEI, JLTI, JGTI, JLEI, JGEI,
+    JTAB, JBIN, ENT, ADJ, LEV, LI, LC, SI, SC, LIX, LCX, SIX, SCX, IXA, PUSH,
     OR, XOR, AND, EQ, NE, LT, GT, LE, GE, SHL, SHR, ADD, SUB, MUL, DIV, MOD,
-    OPEN, READ, CLOS, PRTF, MALC, MSET, MCMP, EXIT
+    ADDI, SHLI, SHRI, MULI, DIVI, DIVS, MODI,
+    LAZY, TICK, TICKL,
+    OPEN, READ, CLOS, PRTF, MALC, MSET, MCMP, MCPY, MMOV, SLEN, MCHR, SCMP, SYSC, DPRF, CLKT, WRIT, MMAP, MUNM, EXIT,
+    HOOK
 };
 
 // tokens and classes (operators last and in precedence order)
 enum {
     Num=128, Fun, Sys, Glo, Loc, Id,
-    Char, Else, Enum, If, Int, Return, Sizeof, While,
+    Break, Case, Char, Continue, Default, Do, Else, Enum, For, If, Int, Return, Sizeof, Switch, While,
     Assign, Cond, Lor, Lan, Or, Xor, And, Eq, Ne, Lt, Gt, Le, Ge, Shl, Shr, Add, Sub, Mul, Div, Mod, Inc, Dec, Brak
 };
 
 int  token_val;    // value of current token (mainly for number)
 int *current_id,   // current parsed ID
-    *symbols;      // symbol table
+    *symbols,      // symbol table
+    *symbols_end,  // first free entry of the symbol table
+    *buckets,      // hash chains of the symbol table, SYMBOL_BUCKETS heads
+    *locals,       // identifiers bound as locals of the function being compiled
+    *last_local;   // last entry used in locals
 
 // fields of identifier
-enum {Token, Hash, Name, Type, Class, Value, BType, BClass, BValue, IdSize};
+enum {Token, Hash, Name, Type, Class, Value, BType, BClass, BValue, Src, Line, Link, Count, Data, IdSize};
+enum { SYMBOL_BUCKETS = 4096 };
 
 // type of variable/function
 enum { CHAR, INT, PTR };
+
+// keywords and builtins, looked up by a perfect hash before the symbol table
+enum { KEYWORD_SLOTS = 64 };
+enum { KwName, KwLength, KwToken, KwId, KwSize };
+int *keywords;   // KEYWORD_SLOTS entries of KwSize
+
+// character classes of the lexer
+enum { C_SPACE = 1, C_IDENT = 2, C_DIGIT = 4, C_HEX = 8 };
+char *char_class;   // class bits of each byte value
+
+// read buffers for the `read` builtin, one per file descriptor below FD_MAX
+enum { FD_MAX = 64, FD_BUFSIZE = 65536 };
+int *fd_buf,   // buffer of each descriptor, 0 until it is first read
+    *fd_pos,   // next unread byte in fd_buf
+    *fd_end;   // end of the buffered bytes
 int *idmain;   // the `main` function
 
+// compile function bodies on their first call (--lazy)
+int lazy;
+
+// start functions without optimization and recompile them with -O2 once
+// their calls and loop iterations reach TIER_THRESHOLD (--tiered)
+int tiered;
+enum { TIER_THRESHOLD = 1000 };
+
+// set while a promoted function is compiled again, its string literals are
+// already in data from its first compile and are not copied a second time
+int promoting;
+
+// the function being compiled
+int *function_id;
+
+// run a byte encoding of the program (--compact): one byte opcodes and
+// variable-length operands, jumps relative to the end of the instruction
+int   compact;
+char *code,       // the byte encoded program
+     *cpc;        // its program counter
+int  *code_pos,   // byte position of each instruction of text
+     *code_size;  // its size in bytes
+
+// hardware counters of the compile and the run phase (--perf-counters)
+int   perf_counters;
+int  *perf_fd,        // descriptor of each PERF_* event, -1 if the kernel refused it
+     *perf_compile,   // counts of program(), two words (a 64-bit value) per event
+     *perf_run;       // counts of eval()
+char *perf_attr;      // struct perf_event_attr
+enum { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_BRANCH_MISSES, PERF_L1I_MISSES, PERF_L1D_MISSES, PERF_EVENTS };
+
+// sample the interpreted call stack every PROF_PERIOD function entries and
+// loop iterations, counted by the TICK and TICKL of --tiered, and write the
+// stacks to prof_file in the folded format of flamegraph.pl (--profile)
+int   profile;
+char *prof_file;
+int   prof_left;      // TICKs and TICKLs until the next sample
+int  *prof_func,      // function of each text word, 0 until first sampled
+     *prof_stacks,    // distinct stacks: [link, count, depth, function...]
+     *prof_end,       // end of prof_stacks
+     *prof_buckets,   // hash chains of prof_stacks
+     prof_dropped;    // samples that did not fit in prof_stacks
+enum { PROF_PERIOD = 997, PROF_DEPTH = 256, PROF_BUCKETS = 1024 };
+
+// record the last TRACE_RECORDS instructions in a file mapped shared, so
+// they survive a crash of xc (--trace), and print them (--trace-decode)
+int   trace;
+char *trace_file;
+int  *trace_map,        // Tr* header, the ring of records, the function table
+     *trace_pos,        // next record: [pc index << 8 | op, ax, words on the stack]
+     *trace_ring_end;
+enum { TRACE_RECORDS = 8192, TRACE_TABLE = 16384, TRACE_MAGIC = 1381253976 };   // "XCTR"
+enum { TrMagic, TrWordSize, TrBase, TrNext, TrWrapped, TrDone, TrExit, TrFunctions, TrText, TrHeader };
+
+// --trace and --write-profile replace every instruction by HOOK, which puts
+// it back and records it before it runs, so that other runs pay nothing
+int *hook_shadow,   // the instruction replaced at each text word
+    *hook_prev,     // the instruction run last, HOOK goes back on it next
+    *hook_end;      // the last text word replaced, 0 when nothing is
+
+// count the calls of each function and how often each conditional branch
+// jumps (--write-profile), then lay out the most called functions first at
+// the start of text when compiling with such a profile (--use-profile)
+int   pgo;          // 1 to write a profile, 2 to use one
+char *pgo_file;
+char *pgo_data;     // text of the profile used
+int  *pgo_count,    // executions of each text word
+     *pgo_taken,    // jumps of each conditional branch
+     *pgo_last;     // the conditional branch executed last, 0 otherwise
+
+// print the code of each function and its statistics instead of running (-S)
+int  disasm;
+int *line_of;   // source line of the statement starting at each text word, or 0
+
+int *stack_top;   // bp of the frame below main
+
+// report the time of each phase and how much of each pool was used (--stats)
+int   stats;
+int   tokens;        // tokens read by next()
+int  *stats_clock;   // struct timespec
+int   stats_base;    // second of the first stats_now()
+char *old_data;      // start of the data segment
+
+// optimize the code of each function once it is compiled (-O2)
+int opt_level;
+int *opt_flags,   // O_* bits of each word of the function being optimized
+    *opt_pos;     // new index of each word after compaction
+enum { O_INSN = 1, O_LABEL = 2, O_LIVE = 4, O_DEAD = 8 };
+
+// state of the innermost switch and of the innermost loop or switch
+int *cases,          // [value, address] of every case label seen so far
+    *case_end,       // end of cases
+    *case_base,      // first case of the innermost switch, 0 outside a switch
+    *case_default,   // address of its default label, 0 if none
+    *break_list,     // JMPs of break waiting for the end of the loop or switch,
+                     // chained through their operands
+    *continue_list;  // JMPs of continue waiting for the test of the loop
+int breakable,       // number of enclosing loops and switches
+    loops;           // number of enclosing loops
+
+// the comparison ending the code emitted so far, 0 if there is none, and
+// whether its right operand is a single IMM
+int *last_cmp, cmp_imm;
+
+// the last load of a local from its frame slot (LL)
+int *last_slot;
+
 // type of a declaration, make it global for convenience
 int basetype;
 // type of an expression
@@ -62,50 +197,175 @@ int index_of_bp;
 
 // clang-format on
 
+// hash of a keyword or builtin name, only its length, first two and last
+// characters are used. the weights were searched offline so that every name
+// added by init_keywords() gets a slot of its own
+int keyword_hash(char *name, int len)
+{
+    return (len + name[0] * 10 + name[1] * 11 + name[len - 1] * 26) & (KEYWORD_SLOTS - 1);
+}
+
+// append an identifier to the symbol table and to the chain of its hash
+int *new_symbol(char *name, int hash)
+{
+    int *id, *head;
+
+    id          = symbols_end;
+    symbols_end = symbols_end + IdSize;
+    head        = buckets + (hash & (SYMBOL_BUCKETS - 1));
+
+    id[Token] = Id;
+    id[Hash]  = hash;
+    id[Name]  = (int)name;   // 32-bit machine, sizeof(int) == sizeof(char *)
+    id[Link]  = *head;
+    *head     = (int)id;
+    return id;
+}
+
+// add an identifier that is not read from the source, hashed the same way next() does
+int *add_symbol(char *name, int len)
+{
+    int hash, i;
+
+    hash = *name;
+    i    = 1;
+    while (i < len) {
+        hash = hash * 147 + name[i++];
+    }
+    return new_symbol(name, hash);
+}
+
+// add a keyword (tk is its token) or a builtin (tk is Id, op its instruction)
+void add_keyword(char *name, int tk, int op)
+{
+    int *kw, *id;
+    int  len;
+
+    len = strlen(name);
+    kw  = keywords + keyword_hash(name, len) * KwSize;
+    if (kw[KwName]) {
+        printf("keyword hash collision: %s and %s\n", name, (char *)kw[KwName]);
+        exit(-1);
+    }
+    kw[KwName]   = (int)name;
+    kw[KwLength] = len;
+    kw[KwToken]  = tk;
+
+    if (tk == Id) {
+        // builtins stay in the symbol table so a local variable may shadow them
+        id        = add_symbol(name, len);
+        id[Class] = Sys;
+        id[Type]  = INT;
+        id[Value] = op;
+        kw[KwId]  = (int)id;
+    }
+}
+
+void init_keywords()
+{
+    add_keyword("break", Break, 0);
+    add_keyword("case", Case, 0);
+    add_keyword("char", Char, 0);
+    add_keyword("continue", Continue, 0);
+    add_keyword("default", Default, 0);
+    add_keyword("do", Do, 0);
+    add_keyword("else", Else, 0);
+    add_keyword("enum", Enum, 0);
+    add_keyword("for", For, 0);
+    add_keyword("if", If, 0);
+    add_keyword("int", Int, 0);
+    add_keyword("return", Return, 0);
+    add_keyword("sizeof", Sizeof, 0);
+    add_keyword("switch", Switch, 0);
+    add_keyword("while", While, 0);
+    add_keyword("void", Char, 0);   // handle void type
+
+    add_keyword("open", Id, OPEN);
+    add_keyword("read", Id, READ);
+    add_keyword("close", Id, CLOS);
+    add_keyword("printf", Id, PRTF);
+    add_keyword("malloc", Id, MALC);
+    add_keyword("memset", Id, MSET);
+    add_keyword("memcmp", Id, MCMP);
+    add_keyword("memcpy", Id, MCPY);
+    add_keyword("memmove", Id, MMOV);
+    add_keyword("strlen", Id, SLEN);
+    add_keyword("memchr", Id, MCHR);
+    add_keyword("strcmp", Id, SCMP);
+    add_keyword("syscall", Id, SYSC);
+    add_keyword("dprintf", Id, DPRF);
+    add_keyword("clock_gettime", Id, CLKT);
+    add_keyword("write", Id, WRIT);
+    add_keyword("mmap", Id, MMAP);
+    add_keyword("munmap", Id, MUNM);
+    add_keyword("exit", Id, EXIT);
+
+    idmain = add_symbol("main", 4);   // keep track of main
+}
+
 // lexical analyzer
 // get next token
 void next()
 {
     char *last_pos;
     int   hash;   // hash value
+    int  *kw;
+    tokens++;
     while ((token = *src)) {
         ++src;
         if (token == '\n') {
             // new line
             ++line;
         }
+        else if (char_class[token & 255] & C_SPACE) {
+            // skip white space before trying any other token
+        }
         else if (token == '#') {
             // skip macro, because we will not support it
-            while (*src != 0 && *src != '\n') {
-                src++;
+            // memchr scans for the end of line a vector at a time
+            if (!(src = memchr(src, '\n', src_end - src))) {
+                src = src_end;
             }
         }
-        else if ((token >= 'a' && token <= 'z') || (token >= 'A' && token <= 'Z') || token == '_') {
+        else if ((char_class[token & 255] & (C_IDENT | C_DIGIT)) == C_IDENT) {
             // parse identifier
             last_pos = src - 1;
             hash     = token;
-            while ((*src >= 'a' && *src <= 'z') || (*src >= 'A' && *src <= 'Z') ||
-                   (*src >= '0' && *src <= '9') || (*src == '_')) {
+            while (char_class[*src & 255] & (C_IDENT | C_DIGIT)) {
                 hash = hash * 147 + *src;
                 src++;
             }
 
-            // look for existing identiifier, linear search
-            current_id = symbols;
-            while (current_id[Token]) {
+            // keywords and builtins never reach the symbol table search
+            kw = keywords + keyword_hash(last_pos, src - last_pos) * KwSize;
+            if (kw[KwLength] == src - last_pos &&
+                !memcmp((char *)kw[KwName], last_pos, src - last_pos)) {
+                if (kw[KwId]) {
+                    // builtin, an ordinary symbol of class Sys
+                    current_id = (int *)kw[KwId];
+                    token      = current_id[Token];
+                }
+                else {
+                    token = kw[KwToken];
+                }
+                return;
+            }
+
+            // look for existing identiifier, only along the chain of its hash
+            current_id = (int *)buckets[hash & (SYMBOL_BUCKETS - 1)];
+            while (current_id) {
                 if (current_id[Hash] == hash &&
                     !memcmp((char *)current_id[Name], last_pos, src - last_pos)) {
                     // found one, return
                     token = current_id[Token];
                     return;
                 }
-                current_id = current_id + IdSize;
+                current_id = (int *)current_id[Link];
             }
 
             // store new ID
-            current_id[Name] = (int)last_pos;   // 32-bit machine, sizeof(int) == sizeof(char *)
-            current_id[Hash] = hash;
-            token = current_id[Token] = Id;
+            current_id = new_symbol(last_pos, hash);
+            token      = Id;
             return;
         }
         else if (token >= '0' && token <= '9') {
@@ -113,7 +373,7 @@ void next()
             token_val = token - '0';
             if (token_val > 0) {
                 // dec, starts with [1-9]
-                while (*src >= '0' && *src <= '9') {
+                while (char_class[*src & 255] & C_DIGIT) {
                     token_val = token_val * 10 + *src++ - '0';
                 }
             }
@@ -122,8 +382,7 @@ void next()
                 if (*src == 'x' || *src == 'X') {
                     // hex
                     token = *++src;
-                    while ((token >= '0' && token <= '9') || (token >= 'a' && token <= 'f') ||
-                           (token >= 'A' && token <= 'F')) {
+                    while (char_class[token & 255] & C_HEX) {
                         // (token & 15) to get the hex single digit value of token (from c4)
                         token_val = token_val * 16 + (token & 15) + (token >= 'A' ? 9 : 0);
                         token     = *++src;
@@ -152,8 +411,11 @@ void next()
                         token_val = '\n';
                     }
                 }
+                if (token == '"' && !promoting) {
+                    *data = token_val;
+                }
                 if (token == '"') {
-                    *data++ = token_val;
+                    data++;
                 }
             }
             src++;
@@ -171,8 +433,8 @@ void next()
             // comments or divide operator
             if (*src == '/') {
                 // skip comments
-                while (*src != 0 && *src != '\n') {
-                    ++src;
+                if (!(src = memchr(src, '\n', src_end - src))) {
+                    src = src_end;
                 }
             }
             else {
@@ -303,6 +565,30 @@ void next()
     return;
 }
 
+// fill the lexer's character class table
+void init_char_class()
+{
+    int c;
+    c = 0;
+    while (c < 256) {
+        char_class[c] = 0;
+        if (c == ' ' || (c >= 9 && c <= 13)) {
+            // '\t', '\n', '\v', '\f', '\r' written as numbers, the lexer only knows '\n'
+            char_class[c] = C_SPACE;
+        }
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') {
+            char_class[c] = C_IDENT;
+        }
+        if (c >= '0' && c <= '9') {
+            char_class[c] = C_DIGIT | C_HEX;
+        }
+        if ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')) {
+            char_class[c] = char_class[c] | C_HEX;
+        }
+        c++;
+    }
+}
+
 void match(int tk)
 {
     if (token == tk) {
@@ -315,11 +601,112 @@ void match(int tk)
 }
 
 // analytical expression
+// note the comparison just emitted, push is the PUSH of its left operand
+void compared(int *push)
+{
+    last_cmp = text;
+    cmp_imm  = (text == push + 3 && push[1] == IMM);
+}
+
+// emit a jump taken when the condition just compiled is zero (or non-zero
+// with on_true) and return its operand for patching. A condition ending in
+// a comparison is fused into one J<cc> or J<cc>I <value>, which jumps when
+// <cc> holds and leaves ax 0 when jumping and 1 otherwise, like the
+// comparison and JZ it replaces. JNZ needs ax non-zero when jumping, so
+// its fused form leaves a wrong ax and is only for statements.
+int *branch(int on_true)
+{
+    int cc, value;
+
+    if (last_cmp != text) {
+        *++text = on_true ? JNZ : JZ;
+        return ++text;
+    }
+
+    cc = *text - EQ;   // EQ, NE, LT, GT, LE, GE
+    if (!on_true) {
+        cc = (cc < 2) ? 1 - cc : 7 - cc;   // the negation
+    }
+    if (cmp_imm) {
+        value   = text[-1];
+        text    = text - 4;   // drop PUSH IMM <value> <cmp>
+        *++text = JEQI + cc;
+        *++text = value;
+    }
+    else {
+        *text = JEQ + cc;
+    }
+    last_cmp = 0;
+    return ++text;
+}
+
+// whether the right operand compiled since push is a single IMM
+int imm_operand(int *push)
+{
+    return text == push + 2 && push[1] == IMM;
+}
+
+// replace the PUSH IMM <value> ending the code by op <value>
+void emit_imm(int op, int value)
+{
+    text    = text - 3;
+    *++text = op;
+    *++text = value;
+}
+
+// log2 of value if it is a power of two, otherwise -1
+int log2_of(int value)
+{
+    int n;
+    if (value <= 0 || (value & (value - 1))) {
+        return -1;
+    }
+    n = 0;
+    while (value > 1) {
+        value = value >> 1;
+        n++;
+    }
+    return n;
+}
+
+// split a scaled-index load ending the code into the address and a plain
+// load, for the operators that need the address itself
+void unscale_load()
+{
+    if (*text == LIX) {
+        *text   = IXA;
+        *++text = LI;
+    }
+    else if (*text == LCX) {
+        *text   = ADD;
+        *++text = LC;
+    }
+}
+
+// whether the code ends with the load of a local from its frame slot
+int slot_load()
+{
+    return last_slot == text - 1 && *last_slot == LL;
+}
+
+// split a frame slot load ending the code into the address and LI, for
+// the operators that need the address itself
+void unslot_load()
+{
+    if (slot_load()) {
+        *last_slot = LEA;
+        *++text    = LI;
+    }
+}
+
 void expression(int level)
 {
     int *id;
     int  tmp;
     int *addr;
+    int  scaled;   // the lvalue of an assignment is a scaled index
+    int  slot;     // the frame slot of an assigned local
+    int  step;     // the increment of ++ and --
 
     // unary operator
     if (token == Num) {
@@ -431,9 +818,12 @@ void expression(int level)
         else {
             // variable
             if (id[Class] == Loc) {
-                // store local variable address to ax
-                *++text = LEA;
-                *++text = index_of_bp - id[Value];
+                // load the local straight from its frame slot, the
+                // operators needing its address turn LL into LEA LI
+                *++text   = LL;
+                *++text   = index_of_bp - id[Value];
+                last_slot = text - 1;
+                expr_type = id[Type];
             }
             else if (id[Class] == Glo) {
                 // store global variable address to ax
@@ -448,8 +838,10 @@ void expression(int level)
             // 6 emit code
             // default behaviour is to load the variable of the address
             // which is stored in `ax`
-            expr_type = id[Type];
-            *++text   = (expr_type == Char) ? LC : LI;
+            if (id[Class] == Glo) {
+                expr_type = id[Type];
+                *++text   = (expr_type == Char) ? LC : LI;
+            }
         }
     }
     else if (token == '(') {
@@ -494,6 +886,8 @@ void expression(int level)
         // get the address of
         match(And);
         expression(Inc);   // get the address of
+        unscale_load();
+        unslot_load();
         if (*text == LC || *text == LI) {
             text--;        // delete LC/LI
         }
@@ -559,25 +953,36 @@ void expression(int level)
         tmp = token;
         match(token);
         expression(Inc);
+        unscale_load();
 
-        // need to use address of variable twice, so push and LC/LI
-        if (*text == LC) {
-            *text   = PUSH;   // to duplicate the address
-            *++text = LC;
-        }
-        else if (*text == LI) {
-            *text   = PUSH;
-            *++text = LI;
+        step = (expr_type > PTR) ? sizeof(int) : sizeof(char);   // for pointer
+        if (slot_load() && expr_type != CHAR) {
+            // a local is updated in its frame slot
+            *last_slot = INCL;
+            *++text    = (tmp == Inc) ? step : -step;
         }
         else {
-            printf("%d: bad lvalue of pre-increment\n", line);
-            exit(-1);
+            unslot_load();
+
+            // need to use address of variable twice, so push and LC/LI
+            if (*text == LC) {
+                *text   = PUSH;   // to duplicate the address
+                *++text = LC;
+            }
+            else if (*text == LI) {
+                *text   = PUSH;
+                *++text = LI;
+            }
+            else {
+                printf("%d: bad lvalue of pre-increment\n", line);
+                exit(-1);
+            }
+            *++text = PUSH;
+            *++text = IMM;
+            *++text = step;
+            *++text = (tmp == Inc) ? ADD : SUB;
+            *++text = (expr_type == CHAR) ? SC : SI;
         }
-        *++text = PUSH;
-        *++text = IMM;
-        *++text = (expr_type > PTR) ? sizeof(int) : sizeof(char);   // for pointer
-        *++text = (tmp == Inc) ? ADD : SUB;
-        *++text = (expr_type == CHAR) ? SC : SI;
     }
 
     // binary operator and postfix operator
@@ -588,23 +993,39 @@ void expression(int level)
         if (token == Assign) {
             // var = expr;
             match(Assign);
-            if (*text == LC || *text == LI) {
-                *text = PUSH;   // save the lvalue's pointer
+            if (slot_load() && tmp != CHAR) {
+                // a local is stored to its frame slot directly
+                slot = *text;
+                text = text - 2;
+                expression(Assign);
+                *++text = SL;
+                *++text = slot;
             }
             else {
-                printf("%d: bad lvalue in assignment\n", line);
-                exit(-1);
-            }
-            expression(Assign);
+                unslot_load();
+                scaled = (*text == LCX || *text == LIX);
+                if (*text == LC || *text == LI || scaled) {
+                    *text = PUSH;   // save the lvalue's pointer, or base and index
+                }
+                else {
+                    printf("%d: bad lvalue in assignment\n", line);
+                    exit(-1);
+                }
+                expression(Assign);
 
+                if (scaled) {
+                    *++text = (tmp == CHAR) ? SCX : SIX;
+                }
+                else {
+                    *++text = (tmp == CHAR) ? SC : SI;
+                }
+            }
             expr_type = tmp;
-            *++text   = (expr_type == CHAR) ? SC : SI;
         }
         else if (token == Cond) {
             // expr ? a : b;
             match(Cond);
-            *++text = JZ;
-            addr    = ++text;
+            addr = branch(0);
             expression(Assign);
             if (token == ':') {
                 match(':');
@@ -617,25 +1038,27 @@ void expression(int level)
             *++text = JMP;
             addr    = ++text;
             expression(Cond);
-            *addr = (int)(text + 1);
+            *addr    = (int)(text + 1);
+            last_cmp = 0;
         }
         else if (token == Lor) {
-            // logic or
+            // logic or, not fused as the value must stay non-zero
             match(Lor);
             *++text = JNZ;
             addr    = ++text;
             expression(Lan);
             *addr     = (int)(text + 1);
             expr_type = INT;
+            last_cmp  = 0;
         }
         else if (token == Lan) {
             // logic and
             match(Lan);
-            *++text = JZ;
-            addr    = ++text;
+            addr = branch(0);
             expression(Or);
             *addr     = (int)(text + 1);
             expr_type = INT;
+            last_cmp  = 0;
         }
         else if (token == Or) {
             // bitwise or
@@ -665,64 +1088,88 @@ void expression(int level)
             // equal ==
             match(Eq);
             *++text = PUSH;
+            addr    = text;
             expression(Ne);
-            *++text   = EQ;
+            *++text = EQ;
+            compared(addr);
             expr_type = INT;
         }
         else if (token == Ne) {
             // not equal !=
             match(Ne);
             *++text = PUSH;
+            addr    = text;
             expression(Lt);
-            *++text   = NE;
+            *++text = NE;
+            compared(addr);
             expr_type = INT;
         }
         else if (token == Lt) {
             // less than
             match(Lt);
             *++text = PUSH;
+            addr    = text;
             expression(Shl);
-            *++text   = LT;
+            *++text = LT;
+            compared(addr);
             expr_type = INT;
         }
         else if (token == Gt) {
             // greater than
             match(Gt);
             *++text = PUSH;
+            addr    = text;
             expression(Shl);
-            *++text   = GT;
+            *++text = GT;
+            compared(addr);
             expr_type = INT;
         }
         else if (token == Le) {
             // less than or equal to
             match(Le);
             *++text = PUSH;
+            addr    = text;
             expression(Shl);
-            *++text   = LE;
+            *++text = LE;
+            compared(addr);
             expr_type = INT;
         }
         else if (token == Ge) {
             // greater than or equal to
             match(Ge);
             *++text = PUSH;
+            addr    = text;
             expression(Shl);
-            *++text   = GE;
+            *++text = GE;
+            compared(addr);
             expr_type = INT;
         }
         else if (token == Shl) {
             // shift left
             match(Shl);
             *++text = PUSH;
+            addr    = text;
             expression(Add);
-            *++text   = SHL;
+            if (imm_operand(addr)) {
+                emit_imm(SHLI, *text);
+            }
+            else {
+                *++text = SHL;
+            }
             expr_type = INT;
         }
         else if (token == Shr) {
             // shift right
             match(Shr);
             *++text = PUSH;
+            addr    = text;
             expression(Add);
-            *++text   = SHR;
+            if (imm_operand(addr)) {
+                emit_imm(SHRI, *text);
+            }
+            else {
+                *++text = SHR;
+            }
             expr_type = INT;
         }
         else if (token == Add) {
@@ -734,12 +1181,11 @@ void expression(int level)
             expr_type = tmp;
             if (expr_type > PTR) {
                 // pointer type, and not `char *`
-                *++text = PUSH;
-                *++text = IMM;
-                *++text = sizeof(int);
-                *++text = MUL;
+                *++text = IXA;
+            }
+            else {
+                *++text = ADD;
             }
-            *++text = ADD;
         }
         else if (token == Sub) {
             // sub
@@ -747,20 +1193,16 @@ void expression(int level)
             *++text = PUSH;
             expression(Mul);
             if (tmp > PTR && tmp == expr_type) {
-                // pointer subtraction
+                // pointer subtraction, the difference is exact
                 *++text   = SUB;
-                *++text   = PUSH;
-                *++text   = IMM;
-                *++text   = sizeof(int);
-                *++text   = DIV;
+                *++text   = SHRI;
+                *++text   = log2_of(sizeof(int));
                 expr_type = INT;
             }
             else if (tmp > PTR) {
                 // pointer movement
-                *++text   = PUSH;
-                *++text   = IMM;
-                *++text   = sizeof(int);
-                *++text   = MUL;
+                *++text   = SHLI;
+                *++text   = log2_of(sizeof(int));
                 *++text   = SUB;
                 expr_type = tmp;
             }
@@ -774,52 +1216,91 @@ void expression(int level)
             // multiply
             match(Mul);
             *++text = PUSH;
+            addr    = text;
             expression(Inc);
-            *++text   = MUL;
+            if (imm_operand(addr) && log2_of(*text) >= 0) {
+                emit_imm(SHLI, log2_of(*text));
+            }
+            else if (imm_operand(addr)) {
+                emit_imm(MULI, *text);
+            }
+            else {
+                *++text = MUL;
+            }
             expr_type = tmp;
         }
         else if (token == Div) {
             // divide
             match(Div);
             *++text = PUSH;
+            addr    = text;
             expression(Inc);
-            *++text   = DIV;
+            if (imm_operand(addr) && log2_of(*text) >= 0) {
+                emit_imm(DIVS, log2_of(*text));
+            }
+            else if (imm_operand(addr) && *text) {
+                emit_imm(DIVI, *text);
+            }
+            else {
+                *++text = DIV;
+            }
             expr_type = tmp;
         }
         else if (token == Mod) {
             // Modulo
             match(Mod);
             *++text = PUSH;
+            addr    = text;
             expression(Inc);
-            *++text   = MOD;
+            if (imm_operand(addr) && *text) {
+                emit_imm(MODI, *text);
+            }
+            else {
+                *++text = MOD;
+            }
             expr_type = tmp;
         }
         else if (token == Inc || token == Dec) {
             // postfix inc(++) and dec(--)
             // we will increase the value to the variable and decrease it
             // on `ax` to get its original value.
-            if (*text == LI) {
-                *text   = PUSH;
-                *++text = LI;
+            unscale_load();
+            step = (expr_type > PTR) ? sizeof(int) : sizeof(char);
+            if (token == Dec) {
+                step = -step;
             }
-            else if (*text == LC) {
-                *text   = PUSH;
-                *++text = LC;
+            if (slot_load() && expr_type != CHAR) {
+                // a local is updated in its frame slot
+                *last_slot = INCL;
+                *++text    = step;
+                *++text    = ADDI;
+                *++text    = -step;
             }
             else {
-                printf("%d: bad value in increment\n", line);
-                exit(-1);
-            }
+                unslot_load();
+                if (*text == LI) {
+                    *text   = PUSH;
+                    *++text = LI;
+                }
+                else if (*text == LC) {
+                    *text   = PUSH;
+                    *++text = LC;
+                }
+                else {
+                    printf("%d: bad value in increment\n", line);
+                    exit(-1);
+                }
 
-            *++text = PUSH;
-            *++text = IMM;
-            *++text = (expr_type > PTR) ? sizeof(int) : sizeof(char);
-            *++text = (token == Inc) ? ADD : SUB;
-            *++text = (expr_type == CHAR) ? SC : SI;
-            *++text = PUSH;
-            *++text = IMM;
-            *++text = (expr_type > PTR) ? sizeof(int) : sizeof(char);
-            *++text = (token == Inc) ? SUB : ADD;
+                *++text = PUSH;
+                *++text = IMM;
+                *++text = step;
+                *++text = ADD;
+                *++text = (expr_type == CHAR) ? SC : SI;
+                *++text = PUSH;
+                *++text = IMM;
+                *++text = step;
+                *++text = SUB;
+            }
             match(token);
         }
         else if (token == Brak) {
@@ -829,20 +1310,13 @@ void expression(int level)
             expression(Assign);
             match(']');
 
-            if (tmp > PTR) {
-                // pointer, `not char *`
-                *++text = PUSH;
-                *++text = IMM;
-                *++text = sizeof(int);
-                *++text = MUL;
-            }
-            else if (tmp < PTR) {
+            if (tmp < PTR) {
                 printf("%d: pointer type expected\n", line);
                 exit(-1);
             }
+            // load at base + index scaled by the element size
             expr_type = tmp - PTR;
-            *++text   = ADD;
-            *++text   = (expr_type == CHAR) ? LC : LI;
+            *++text   = (expr_type == CHAR) ? LCX : LIX;
         }
         else {
             printf("%d: compiler error, token = %d\n", line, token);
@@ -851,9 +1325,110 @@ void expression(int level)
     }
 }
 
+// emit the dispatch of a switch whose value is in ax, its cases are
+// [case_base, case_end) and def is the target when none matches
+void switch_dispatch(int *def)
+{
+    int *c, *p, *table;
+    int  n, value, addr, range;
+
+    // sort the cases by value
+    c = case_base + 2;
+    while (c < case_end) {
+        value = c[0];
+        addr  = c[1];
+        p     = c;
+        while (p > case_base && p[-2] > value) {
+            p[0] = p[-2];
+            p[1] = p[-1];
+            p    = p - 2;
+        }
+        p[0] = value;
+        p[1] = addr;
+        c    = c + 2;
+    }
+
+    n = (case_end - case_base) / 2;
+    if (n == 0) {
+        *++text = JMP;
+        *++text = (int)def;
+        return;
+    }
+
+    // the table lives in data, jumping through it is a single instruction
+    data  = (char *)(((int)data + sizeof(int) - 1) & (-sizeof(int)));
+    table = (int *)data;
+    range = case_end[-2] - case_base[0] + 1;
+    if (n >= 3 && range > 0 && range <= 2 * n) {
+        // dense: [min, max, default, address of min, ..., address of max]
+        table[0] = case_base[0];
+        table[1] = case_end[-2];
+        table[2] = (int)def;
+        c        = table + 3;
+        while (c < table + 3 + range) {
+            *c++ = (int)def;
+        }
+        c = case_base;
+        while (c < case_end) {
+            table[3 + c[0] - table[0]] = c[1];
+            c                          = c + 2;
+        }
+        data    = (char *)(table + 3 + range);
+        *++text = JTAB;
+    }
+    else {
+        // sparse: [count, default, value, address, ...] searched by value
+        table[0] = n;
+        table[1] = (int)def;
+        memcpy(table + 2, case_base, n * 2 * sizeof(int));
+        data    = (char *)(table + 2 + n * 2);
+        *++text = JBIN;
+    }
+    *++text = (int)table;
+}
+
+// point a chain of pending jumps at target
+void patch_jumps(int *list, int *target)
+{
+    int *next_jmp;
+    while (list) {
+        next_jmp = (int *)*list;
+        *list    = (int)target;
+        list     = next_jmp;
+    }
+}
+
+// compile the condition found at pos again, the token there was a punctuator
+void loop_condition(char *pos, int ln)
+{
+    src  = pos;
+    line = ln;
+    next();
+    expression(Assign);
+}
+
+// count an iteration of the loop being compiled towards promoting the
+// function, or towards the next sample of the profiler
+void tick_loop()
+{
+    if (tiered || profile) {
+        *++text = TICKL;
+        *++text = (int)function_id;
+    }
+}
+
 void statement()
 {
-    int *a, *b;   // for branch contral
+    int  *a, *b;   // for branch contral
+    int  *old_base, *old_default, *old_breaks, *old_continues;
+    int  *c;
+    char *cond_src, *step_src, *after_src;   // to compile a loop test again below its body
+    int   cond_line, step_line, after_line, after_token, after_val;
+    int  *after_id;
+
+    if (line_of) {
+        line_of[text + 1 - old_text] = line;
+    }
 
     // try draw to understand <if> and <while>
     if (token == If) {
@@ -871,8 +1446,7 @@ void statement()
         expression(Assign);   // parse condition
         match(')');
 
-        *++text = JZ;
-        b       = ++text;
+        b = branch(0);
 
         statement();           // parse statement
 
@@ -890,57 +1464,301 @@ void statement()
         *b = (int)(text + 1);
     }
     else if (token == While) {
-        // a:                     a:
-        //    while (<cond>)        <cond>
-        //                          JZ b
-        //     <statement>          <statement>
-        //                          JMP a
-        // b:                     b:
+        // the test is compiled twice, in front of the loop and at its
+        // bottom, so an iteration takes one jump instead of two
+        //
+        //    while (<cond>)          <cond>
+        //                            JZ b
+        //        <statement>      a: <statement>
+        //                         c: <cond>
+        //                            JNZ a
+        //                         b:
         match(While);
-        a = text + 1;
-
+        cond_src  = src;
+        cond_line = line;
         match('(');
         expression(Assign);
         match(')');
 
-        *++text = JZ;
-        b       = ++text;
+        b = branch(0);
 
+        old_breaks    = break_list;
+        old_continues = continue_list;
+        a             = text + 1;
+        break_list    = 0;
+        continue_list = 0;
+        breakable++;
+        loops++;
         statement();
+        loops--;
+        breakable--;
 
-        *++text = JMP;
-        *++text = (int)a;
-        *b      = (int)(text + 1);
-    }
-    else if (token == Return) {
-        // return [expression];
-        match(Return);
+        after_src   = src;
+        after_line  = line;
+        after_token = token;
+        after_val   = token_val;
+        after_id    = current_id;
+        patch_jumps(continue_list, text + 1);
+        tick_loop();
+        loop_condition(cond_src, cond_line);
+        c  = branch(1);
+        *c = (int)a;
 
+        src        = after_src;
+        line       = after_line;
+        token      = after_token;
+        token_val  = after_val;
+        current_id = after_id;
+        *b         = (int)(text + 1);
+        patch_jumps(break_list, text + 1);
+        break_list    = old_breaks;
+        continue_list = old_continues;
+    }
+    else if (token == For) {
+        //    for (<init>; <cond>; <step>)       <init>
+        //                                       <cond>
+        //                                       JZ b
+        //        <statement>                 a: <statement>
+        //                                    c: <step>
+        //                                       <cond>
+        //                                       JNZ a      (JMP a without <cond>)
+        //                                    b:
+        match(For);
+        match('(');
         if (token != ';') {
             expression(Assign);
         }
-
+        cond_src  = src;
+        cond_line = line;
+        match(';');
+        b = 0;
+        if (token != ';') {
+            expression(Assign);
+            b = branch(0);
+        }
+        step_src  = src;
+        step_line = line;
         match(';');
+        if (token != ')') {
+            // only to find the ')', the step is compiled below the body
+            a = text;
+            expression(Assign);
+            text     = a;
+            last_cmp = 0;
+        }
+        match(')');
 
-        // emit code for return
-        *++text = LEV;
-    }
-    else if (token == '{') {
-        // { <statement> ... }
-        match('{');
+        old_breaks    = break_list;
+        old_continues = continue_list;
+        a             = text + 1;
+        break_list    = 0;
+        continue_list = 0;
+        breakable++;
+        loops++;
+        statement();
+        loops--;
+        breakable--;
 
-        while (token != '}') {
-            statement();
+        after_src   = src;
+        after_line  = line;
+        after_token = token;
+        after_val   = token_val;
+        after_id    = current_id;
+        patch_jumps(continue_list, text + 1);
+        tick_loop();
+        src  = step_src;
+        line = step_line;
+        next();
+        if (token != ')') {
+            expression(Assign);
+        }
+        if (b) {
+            loop_condition(cond_src, cond_line);
+            c  = branch(1);
+            *c = (int)a;
+        }
+        else {
+            *++text = JMP;
+            *++text = (int)a;
         }
 
-        match('}');
-    }
-    else if (token == ';') {
-        // empty statement
-        match(';');
+        src        = after_src;
+        line       = after_line;
+        token      = after_token;
+        token_val  = after_val;
+        current_id = after_id;
+        if (b) {
+            *b = (int)(text + 1);
+        }
+        patch_jumps(break_list, text + 1);
+        break_list    = old_breaks;
+        continue_list = old_continues;
     }
-    else {
-        // a = b; or function_call();
+    else if (token == Do) {
+        //    do                   a: <statement>
+        //        <statement>      c: <cond>
+        //    while (<cond>);         JNZ a
+        //                         b:
+        match(Do);
+        old_breaks    = break_list;
+        old_continues = continue_list;
+        a             = text + 1;
+        break_list    = 0;
+        continue_list = 0;
+        breakable++;
+        loops++;
+        statement();
+        loops--;
+        breakable--;
+
+        match(While);
+        patch_jumps(continue_list, text + 1);
+        tick_loop();
+        match('(');
+        expression(Assign);
+        match(')');
+        match(';');
+        c  = branch(1);
+        *c = (int)a;
+
+        patch_jumps(break_list, text + 1);
+        break_list    = old_breaks;
+        continue_list = old_continues;
+    }
+    else if (token == Switch) {
+        //   switch (<expr>) {           <expr>
+        //                               JMP d
+        //   case 1:                  a1:
+        //       <statement>             <statement>
+        //   case 7:           ===>   a7:
+        //       <statement>             <statement>
+        //   }                           JMP b
+        //                            d:
+        //                               JTAB/JBIN <table in data>
+        //                            b:
+        //
+        // dense cases jump through a table indexed by the value,
+        // sparse ones through a table searched by binary search
+        match(Switch);
+        match('(');
+        expression(Assign);
+        match(')');
+
+        *++text = JMP;
+        a       = ++text;
+
+        old_base     = case_base;
+        old_default  = case_default;
+        old_breaks   = break_list;
+        case_base    = case_end;
+        case_default = 0;
+        break_list   = 0;
+        breakable++;
+        statement();
+        breakable--;
+
+        *++text = JMP;
+        b       = ++text;
+        *a      = (int)(text + 1);
+        switch_dispatch(case_default ? case_default : text + 3);   // the dispatch is 2 words
+        *b = (int)(text + 1);
+        patch_jumps(break_list, text + 1);
+
+        case_end     = case_base;
+        case_base    = old_base;
+        case_default = old_default;
+        break_list   = old_breaks;
+    }
+    else if (token == Case) {
+        // case <constant>:
+        match(Case);
+        if (!case_base) {
+            printf("%d: case outside switch\n", line);
+            exit(-1);
+        }
+        a = text;
+        expression(Lor);
+        if (text != a + 2 || a[1] != IMM) {
+            printf("%d: case value is not a constant\n", line);
+            exit(-1);
+        }
+        text = a;
+
+        c = case_base;
+        while (c < case_end) {
+            if (c[0] == a[2]) {
+                printf("%d: duplicate case value %d\n", line, a[2]);
+                exit(-1);
+            }
+            c = c + 2;
+        }
+        *case_end++ = a[2];
+        *case_end++ = (int)(text + 1);
+        match(':');
+    }
+    else if (token == Default) {
+        // default:
+        match(Default);
+        if (!case_base || case_default) {
+            printf("%d: bad default label\n", line);
+            exit(-1);
+        }
+        case_default = text + 1;
+        match(':');
+    }
+    else if (token == Break) {
+        // break; jumps to the end of the innermost loop or switch
+        match(Break);
+        match(';');
+        if (!breakable) {
+            printf("%d: break outside loop or switch\n", line);
+            exit(-1);
+        }
+        *++text    = JMP;
+        *++text    = (int)break_list;
+        break_list = text;
+    }
+    else if (token == Continue) {
+        // continue; jumps to the test of the innermost loop
+        match(Continue);
+        match(';');
+        if (!loops) {
+            printf("%d: continue outside loop\n", line);
+            exit(-1);
+        }
+        *++text       = JMP;
+        *++text       = (int)continue_list;
+        continue_list = text;
+    }
+    else if (token == Return) {
+        // return [expression];
+        match(Return);
+
+        if (token != ';') {
+            expression(Assign);
+        }
+
+        match(';');
+
+        // emit code for return
+        *++text = LEV;
+    }
+    else if (token == '{') {
+        // { <statement> ... }
+        match('{');
+
+        while (token != '}') {
+            statement();
+        }
+
+        match('}');
+    }
+    else if (token == ';') {
+        // empty statement
+        match(';');
+    }
+    else {
+        // a = b; or function_call();
         expression(Assign);
         match(';');
     }
@@ -1016,6 +1834,7 @@ void function_parameter()
         current_id[Class]  = Loc;
         current_id[Type]   = type;
         current_id[Value]  = params++;   // index of current parameter
+        *++last_local      = (int)current_id;
 
         if (token == ',') {
             match(',');
@@ -1067,6 +1886,7 @@ void function_body()
             current_id[Class]  = Loc;
             current_id[Type]   = type;
             current_id[Value]  = ++pos_local;   // index of current parameter
+            *++last_local      = (int)current_id;
 
             if (token == ',') {
                 match(',');
@@ -1089,269 +1909,2704 @@ void function_body()
     *++text = LEV;
 }
 
-void function_declaration()
+// number of operands following an instruction
+int operands(int op)
 {
-    match('(');
-    function_parameter();
-    match(')');
-    match('{');
-    function_body();
+    if ((op >= JEQI && op <= JGEI) || op == INCL) {
+        return 2;
+    }
+    if (op <= JBIN || op == ENT || op == ADJ || (op >= ADDI && op <= MODI) || (op >= LAZY && op <= TICKL)) {
+        return 1;
+    }
+    return 0;
+}
 
-    // unbind local variable declarations for all local variables
-    // prevent local variable cover global variable
-    current_id = symbols;
-    while (current_id[Token]) {
-        if (current_id[Class] == Loc) {
-            current_id[Class] = current_id[BClass];
-            current_id[Type]  = current_id[BType];
-            current_id[Value] = current_id[BValue];
-        }
-        current_id = current_id + IdSize;
+// the word holding the target of a jump instruction, 0 for other instructions
+int *jump_operand(int *p)
+{
+    if (*p == JMP || *p == JZ || *p == JNZ || (*p >= JEQ && *p <= JGE)) {
+        return p + 1;
+    }
+    if (*p >= JEQI && *p <= JGEI) {
+        return p + 2;
     }
+    return 0;
 }
 
-void global_declaration()
+// the first and last entries of the address list of a switch table
+int *table_first(int *p)
 {
-    // global_declaration ::= enum_decl | variable_decl | function_decl
-    //
-    // enum_decl ::= 'enum' [id] '{' id ['=' 'num'] {',' id ['=' 'num'} '}'
-    //
-    // variable_decl ::= type {'*'} id { ',' {'*'} id } ';'
-    //
-    // function_decl ::= type {'*'} id '(' parameter_decl ')' '{' body_decl '}'
+    int *table;
+    table = (int *)p[1];
+    return (*p == JTAB) ? table + 2 : table + 1;
+}
 
+int *table_last(int *p)
+{
+    int *table;
+    table = (int *)p[1];
+    return (*p == JTAB) ? table + 3 + table[1] - table[0] : table + 1 + table[0] * 2;
+}
 
-    int type;   // tmp, actual type for variable
-    int i;      // tmp
-    basetype = INT;
+// the address entries of a JBIN table are every other word after the default
+int table_step(int *p)
+{
+    return (*p == JTAB) ? 1 : 2;
+}
 
-    // parse Enum
-    if (token == Enum) {
-        // enum [id] { a = 10, b = 20, ...}
-        match(Enum);
-        if (token != '{') {
-            match(Id);
+// a <op> b for constant folding, op is a binary or an immediate instruction
+int fold(int op, int a, int b)
+{
+    // clang-format off
+    if (op == OR) return a | b;
+    if (op == XOR) return a ^ b;
+    if (op == AND) return a & b;
+    if (op == EQ) return a == b;
+    if (op == NE) return a != b;
+    if (op == LT) return a < b;
+    if (op == GT) return a > b;
+    if (op == LE) return a <= b;
+    if (op == GE) return a >= b;
+    if (op == SHL || op == SHLI) return a << b;
+    if (op == SHR || op == SHRI) return a >> b;
+    if (op == ADD || op == ADDI) return a + b;
+    if (op == SUB) return a - b;
+    if (op == MUL || op == MULI) return a * b;
+    if (op == DIV || op == DIVI) return a / b;
+    if (op == DIVS) return (a < 0 ? a + (1 << b) - 1 : a) >> b;
+    return a % b;   // MOD, MODI
+    // clang-format on
+}
+
+// mark the instructions of [start, end) and the targets of their jumps
+void opt_scan(int *start, int *end)
+{
+    int *p, *q;
+    memset(opt_flags, 0, (end - start + 1) * sizeof(int));
+    p = start;
+    while (p < end) {
+        opt_flags[p - start] = O_INSN;
+        p = p + 1 + operands(*p);
+    }
+    p = start;
+    while (p < end) {
+        if ((q = jump_operand(p)) && (int *)*q >= start && (int *)*q < end) {
+            opt_flags[(int *)*q - start] = opt_flags[(int *)*q - start] | O_LABEL;
         }
-        if (token == '{') {
-            match('{');
-            enum_declaration();
-            match('}');
+        if (*p == JTAB || *p == JBIN) {
+            q = table_first(p);
+            while (q <= table_last(p)) {
+                if ((int *)*q >= start && (int *)*q < end) {
+                    opt_flags[(int *)*q - start] = opt_flags[(int *)*q - start] | O_LABEL;
+                }
+                q = q + table_step(p);
+            }
         }
-        match(';');
-        return;
+        p = p + 1 + operands(*p);
     }
+}
 
-    // parse variable and function
+// the next instruction that is not deleted
+int *opt_next(int *start, int *p)
+{
+    p = p + 1 + operands(*p);
+    while (opt_flags[p - start] & O_DEAD) {
+        p = p + 1 + operands(*p);
+    }
+    return p;
+}
 
-    // parse type information
-    if (token == Int) {
-        match(Int);
-        basetype = INT;
+// delete the instruction at p
+void opt_delete(int *start, int *p)
+{
+    int n;
+    n = operands(*p);
+    while (n >= 0) {
+        opt_flags[p - start + n] = opt_flags[p - start + n] | O_DEAD;
+        n--;
     }
-    else if (token == Char) {
-        match(Char);
-        basetype = CHAR;
+}
+
+// whether ax is overwritten before it is read when running from p
+int ax_dead(int *p)
+{
+    int hops;
+    hops = 0;
+    while (*p == JMP && hops < 8) {
+        p = (int *)p[1];
+        hops++;
     }
+    return *p == IMM || *p == LEA || *p == LL;
+}
 
-    // parse the comma seperated variable declaration.
-    while (token != ';' && token != '}') {
-        type = basetype;
-        // parse pointer type, note that there may exist `int ****x;`
-        while (token == Mul) {
-            match(Mul);
-            type = type + PTR;
-        }
-        if (token != Id) {
-            // invalid declaration
-            printf("%d: bad global declaration\n", line);
-            exit(-1);
-        }
-        if (current_id[Class]) {
-            // identifier exists
-            printf("%d: duplicate global declaration\n", line);
-            exit(-1);
+// whether a jump or switch entry outside [from, to) leads into (from, to)
+int opt_entered(int *start, int *end, int *from, int *to)
+{
+    int *p, *q;
+    p = start;
+    while (p < end) {
+        if (!(opt_flags[p - start] & O_DEAD) && (p < from || p >= to)) {
+            if ((q = jump_operand(p)) && (int *)*q > from && (int *)*q < to) {
+                return 1;
+            }
+            if (*p == JTAB || *p == JBIN) {
+                q = table_first(p);
+                while (q <= table_last(p)) {
+                    if ((int *)*q > from && (int *)*q < to) {
+                        return 1;
+                    }
+                    q = q + table_step(p);
+                }
+            }
         }
-        match(Id);
-        current_id[Type] = type;
+        p = p + 1 + operands(*p);
+    }
+    return 0;
+}
 
-        if (token == '(') {
-            // function
-            current_id[Class] = Fun;
-            current_id[Value] = (int)(text + 1);   // memory address of function
-            function_declaration();
-        }
-        else {
-            // global variable
-            current_id[Class] = Glo;
-            current_id[Value] = (int)data;   // assign memory address
-            data              = data + sizeof(int);
-        }
-        if (token == ',') {
-            match(',');
-        }
+// number of stack words an instruction pops, -1 for PUSH
+int opt_pops(int *p)
+{
+    if (*p == PUSH) {
+        return -1;
     }
-    next();
+    if ((*p >= OR && *p <= MOD) || *p == IXA || *p == LIX || *p == LCX || *p == SI || *p == SC
+        || (*p >= JEQ && *p <= JGE)) {
+        return 1;
+    }
+    if (*p == SIX || *p == SCX) {
+        return 2;
+    }
+    return (*p == ADJ) ? p[1] : 0;
 }
 
-// program entry
-void program()
+// whether an instruction only computes ax and the stack from ax, the stack,
+// the frame and memory, without storing, calling or jumping
+int opt_reads_only(int op)
 {
-    next();
-    while (token > 0) {
-        global_declaration();
+    return op == IMM || op == LL || op == LEA || op == LI || op == LC || op == LIX || op == LCX || op == IXA
+        || op == PUSH || (op >= OR && op <= MOD) || (op >= ADDI && op <= MODI);
+}
+
+// the start of the second copy when the base and index of the LIX or LCX
+// at u are computed twice in a row, as in a[i] = a[i] + 1:
+//
+//   X PUSH X LIX        X computes the base on the stack and the index in
+//                       ax, reading but not writing anything
+//
+// returns 0 otherwise
+int *opt_reloaded(int *start, int *u)
+{
+    int *x, *y, *p;
+    int  len, depth;
+    len = 2;
+    while (len <= 32 && u - 2 * len - 1 >= start) {
+        y = u - len;
+        x = y - 1 - len;
+        if ((opt_flags[x - start] & O_INSN) && (*x == IMM || *x == LL || *x == LEA)
+            && !memcmp(x, y, len * sizeof(int))) {
+            p     = x;
+            depth = 0;
+            while (p < y - 1 && depth >= 0 && !(opt_flags[p - start] & O_DEAD) && opt_reads_only(*p)) {
+                depth = depth - opt_pops(p);
+                p     = p + 1 + operands(*p);
+            }
+            if (p == y - 1 && *p == PUSH && depth == 1) {
+                return y;
+            }
+        }
+        len++;
     }
+    return 0;
 }
 
-// virtual machine entry
-int eval()
+// the SIX or SCX storing to the base and index pushed before the load at
+// u, or 0 when they are used otherwise
+int *opt_store_of(int *start, int *end, int *u)
 {
-    int op, *tmp;
-    while (1) {
-        op = *pc++;
+    int *p;
+    int  depth;
+    p     = u + 1 + operands(*u);
+    depth = 0;
+    while (p < end && depth >= 0) {
+        if (!(opt_flags[p - start] & O_DEAD)) {
+            if ((*p == SIX || *p == SCX) && depth == 0) {
+                return ((*p == SIX) == (*u == LIX)) ? p : 0;
+            }
+            if (*p == ENT || *p == LEV || *p == JTAB || *p == JBIN || *p == EXIT) {
+                return 0;
+            }
+            depth = depth - opt_pops(p);
+        }
+        p = p + 1 + operands(*p);
+    }
+    return 0;
+}
 
-        // MOV
-        if (op == IMM) {
-            // load immediate value to ax
-            ax = *pc++;
+// rewrite the instructions of [start, end) in place, deleted ones are only
+// marked O_DEAD, returns whether anything changed
+int opt_rewrite(int *start, int *end)
+{
+    int *p, *q, *r, *t;
+    int  changed, hops;
+    changed = 0;
+    p       = start;
+    while (p < end) {
+        if (opt_flags[p - start] & O_DEAD) {
+            p = p + 1 + operands(*p);
         }
-        else if (op == LC) {
-            // load character to ax, address in ax
-            ax = *(char *)ax;
+        else if (*p == IMM && (q = opt_next(start, p)) < end && *q >= ADDI && *q <= MODI
+                 && !(opt_flags[q - start] & O_LABEL)) {
+            // IMM a <op>I b  =>  IMM (a op b)
+            p[1] = fold(*q, p[1], q[1]);
+            opt_delete(start, q);
+            changed = 1;
         }
-        else if (op == LI) {
-            // load integer to ax, address in ax
-            ax = *(int *)ax;
+        else if (*p == IMM && (q = opt_next(start, p)) < end && *q == PUSH
+                 && (r = opt_next(start, q)) < end && *r == IMM
+                 && (t = opt_next(start, r)) < end && *t >= OR && *t <= MOD
+                 && !((*t == DIV || *t == MOD) && !r[1])
+                 && !((opt_flags[q - start] | opt_flags[r - start] | opt_flags[t - start]) & O_LABEL)) {
+            // IMM a PUSH IMM b <op>  =>  IMM (a op b)
+            p[1] = fold(*t, p[1], r[1]);
+            opt_delete(start, q);
+            opt_delete(start, r);
+            opt_delete(start, t);
+            changed = 1;
         }
-        else if (op == SC) {
-            // save character to address, value in ax, address on stack
-            ax = *(char *)*sp++ = ax;
+        else if (*p == IMM && (q = opt_next(start, p)) < end && (*q == JZ || *q == JNZ)
+                 && !(opt_flags[q - start] & O_LABEL)) {
+            // a branch on a constant is a jump or nothing, ax keeps the constant
+            if ((*q == JZ) == (p[1] == 0)) {
+                *q = JMP;
+            }
+            else {
+                opt_delete(start, q);
+            }
+            changed = 1;
         }
-        else if (op == SI) {
-            // save integer to address, value in ax, address on stack
-            *(int *)*sp++ = ax;
+        else if ((*p == IMM || *p == LL || *p == ADDI) && (q = opt_next(start, p)) < end && ax_dead(q)) {
+            // a value overwritten before it is used, like that of i++;
+            opt_delete(start, p);
+            changed = 1;
         }
-
-        // PUSH
-        else if (op == PUSH) {
-            // push the value of ax into the stack
-            *--sp = ax;
+        else if (*p == JMP && (q = opt_next(start, p)) == (int *)p[1]) {
+            // a jump to the next instruction
+            opt_delete(start, p);
+            changed = 1;
         }
-
-        // JMP <addr>
-        else if (op == JMP) {
-            // jump to the address
-            pc = (int *)*pc;
+        else if (*p == PUSH && p[1] == IMM && (p[3] == ADD || p[3] == SUB || p[3] == IXA)
+                 && !((opt_flags[p - start + 1] | opt_flags[p - start + 3]) & (O_LABEL | O_DEAD))) {
+            // PUSH IMM c ADD  =>  ADDI c, the same for SUB and IXA
+            if (p[3] == SUB) {
+                p[2] = -p[2];
+            }
+            else if (p[3] == IXA) {
+                p[2] = p[2] * sizeof(int);
+            }
+            p[1] = ADDI;
+            opt_delete(start, p);
+            opt_delete(start, p + 3);
+            changed = 1;
         }
-
-        // JGE, CMPL
-        else if (op == JZ) {
-            // jump if ax is zero
-            pc = ax ? pc + 1 : (int *)*pc;
+        else if (((*p == ADDI || *p == SHLI || *p == SHRI || *p == DIVS) && p[1] == 0)
+                 || ((*p == MULI || *p == DIVI) && p[1] == 1)) {
+            // x << 0, x >> 0, x * 1 and x / 1
+            opt_delete(start, p);
+            changed = 1;
         }
-        else if (op == JNZ) {
-            // jump if ax is not zero
-            pc = ax ? (int *)*pc : pc + 1;
+        else if ((*p == LIX || *p == LCX) && (q = opt_reloaded(start, p)) && (r = opt_store_of(start, end, p))
+                 && !opt_entered(start, end, q - 1 - (p - q), r + 1)) {
+            // an element read and written back is addressed once:
+            // X PUSH X LIX ... SIX  =>  X IXA PUSH LI ... SI
+            t = q;
+            while (t <= p) {
+                opt_delete(start, t);
+                t = t + 1 + operands(*t);
+            }
+            q[-1]                    = (*p == LIX) ? IXA : ADD;
+            q[0]                     = PUSH;
+            q[1]                     = (*p == LIX) ? LI : LC;
+            opt_flags[q - start]     = O_INSN;
+            opt_flags[q - start + 1] = O_INSN;
+            *r                       = (*r == SIX) ? SI : SC;
+            changed                  = 1;
         }
-
-        // CALL
-        else if (op == CALL) {
-            // call subroutine
-            *--sp = (int)(pc + 1);   // push pc to stack
-            pc    = (int *)*pc;      // jump
+        else {
+            // jump threading: go straight to the end of a chain of JMPs
+            if ((q = jump_operand(p))) {
+                t    = (int *)*q;
+                hops = 0;
+                while (t >= start && t < end && *t == JMP && (int *)t[1] != t && hops < 8) {
+                    t = (int *)t[1];
+                    hops++;
+                }
+                if (t != (int *)*q) {
+                    *q      = (int)t;
+                    changed = 1;
+                }
+            }
+            p = p + 1 + operands(*p);
         }
+    }
+    return changed;
+}
 
-        // ENT <size>
-        else if (op == ENT) {
-            // make new stack frame
+// mark the instruction at target, or the first one kept after it, as
+// reachable, returns whether it was not yet and lies before p
+int opt_live(int *start, int *end, int *target, int *p)
+{
+    if (target < start || target >= end) {
+        return 0;
+    }
+    while (target < end && (opt_flags[target - start] & O_DEAD)) {
+        target = target + 1 + operands(*target);
+    }
+    if (target >= end || (opt_flags[target - start] & O_LIVE)) {
+        return 0;
+    }
+    opt_flags[target - start] = opt_flags[target - start] | O_LIVE;
+    return target < p;
+}
+
+// delete the instructions of [start, end) that cannot be reached from start
+void opt_unreachable(int *start, int *end)
+{
+    int *p, *q;
+    int  again;
+    opt_flags[0] = opt_flags[0] | O_LIVE;
+    again        = 1;
+    while (again) {
+        // sweep forward, again when a jump backwards reached something new
+        again = 0;
+        p     = start;
+        while (p < end) {
+            if ((opt_flags[p - start] & (O_LIVE | O_DEAD)) == O_LIVE) {
+                if (*p != JMP && *p != LEV && *p != JTAB && *p != JBIN) {
+                    opt_live(start, end, opt_next(start, p), p);
+                }
+                if ((q = jump_operand(p))) {
+                    again = opt_live(start, end, (int *)*q, p) || again;
+                }
+                if (*p == JTAB || *p == JBIN) {
+                    q = table_first(p);
+                    while (q <= table_last(p)) {
+                        again = opt_live(start, end, (int *)*q, p) || again;
+                        q     = q + table_step(p);
+                    }
+                }
+            }
+            p = p + 1 + operands(*p);
+        }
+    }
+    p = start;
+    while (p < end) {
+        if (!(opt_flags[p - start] & O_LIVE)) {
+            opt_delete(start, p);
+        }
+        p = p + 1 + operands(*p);
+    }
+}
+
+// drop the deleted words of [start, end) and relocate the jumps into it
+void opt_compact(int *start, int *end)
+{
+    int *p, *q;
+    int  i, n;
+
+    // a deleted word moves to the next word that is kept
+    i = 0;
+    n = 0;
+    while (i < end - start) {
+        opt_pos[i] = n;
+        n          = n + !(opt_flags[i] & O_DEAD);
+        i++;
+    }
+    opt_pos[i] = n;
+
+    p = start;
+    while (p < end) {
+        if (!(opt_flags[p - start] & O_DEAD)) {
+            if ((q = jump_operand(p)) && (int *)*q >= start && (int *)*q <= end) {
+                *q = (int)(start + opt_pos[(int *)*q - start]);
+            }
+            if (*p == JTAB || *p == JBIN) {
+                q = table_first(p);
+                while (q <= table_last(p)) {
+                    if ((int *)*q >= start && (int *)*q <= end) {
+                        *q = (int)(start + opt_pos[(int *)*q - start]);
+                    }
+                    q = q + table_step(p);
+                }
+            }
+        }
+        p = p + 1 + operands(*p);
+    }
+    i = 0;
+    while (i < end - start) {
+        if (!(opt_flags[i] & O_DEAD)) {
+            start[opt_pos[i]] = start[i];
+        }
+        if (line_of && (n = line_of[start + i - old_text])) {
+            line_of[start + i - old_text]           = 0;
+            line_of[start + opt_pos[i] - old_text] = n;
+        }
+        i++;
+    }
+    text = start + opt_pos[i] - 1;
+}
+
+// open n words at `at`, the top of the loop [at, loop_end): jumps from the
+// loop to `at` still lead to the loop, those from outside to the new words
+void opt_insert(int *start, int *at, int *loop_end, int n)
+{
+    int *p, *q;
+    p = start;
+    while (p <= text) {
+        if ((q = jump_operand(p)) && ((int *)*q > at || ((int *)*q == at && p >= at && p < loop_end))) {
+            *q = (int)((int *)*q + n);
+        }
+        if (*p == JTAB || *p == JBIN) {
+            q = table_first(p);
+            while (q <= table_last(p)) {
+                if ((int *)*q > at || ((int *)*q == at && p >= at && p < loop_end)) {
+                    *q = (int)((int *)*q + n);
+                }
+                q = q + table_step(p);
+            }
+        }
+        p = p + 1 + operands(*p);
+    }
+    memmove(at + n, at, (text + 1 - at) * sizeof(int));
+    if (line_of) {
+        memmove(line_of + (at + n - old_text), line_of + (at - old_text), (text + 1 - at) * sizeof(int));
+        memset(line_of + (at - old_text), 0, n * sizeof(int));
+    }
+    text = text + n;
+}
+
+// whether the frame slot is written in [from, to), or anywhere through its address
+int opt_written(int *start, int *end, int *from, int *to, int slot)
+{
+    int *p;
+    p = start;
+    while (p < end) {
+        if (!(opt_flags[p - start] & O_DEAD)
+            && ((*p == LEA && p[1] == slot) || ((*p == SL || *p == INCL) && p[1] == slot && p >= from && p < to))) {
+            return 1;
+        }
+        p = p + 1 + operands(*p);
+    }
+    return 0;
+}
+
+// the end of the longest expression starting at s that only combines
+// constants, addresses and locals not written in the loop [from, to), and
+// cannot fault, so that it can run before the loop; 0 if it is a single
+// instruction
+int *opt_invariant(int *start, int *end, int *from, int *to, int *s)
+{
+    int *p, *last;
+    int  depth;
+    p     = s;
+    last  = 0;
+    depth = 0;
+    while (p < to && (p == s || !(opt_flags[p - start] & (O_LABEL | O_DEAD)))) {
+        if (!(*p == IMM || *p == LEA || *p == PUSH || *p == IXA || (*p >= OR && *p <= MUL)
+              || (*p >= ADDI && *p <= MULI) || (*p == LL && !opt_written(start, end, from, to, p[1])))
+            || (p == s && *p != IMM && *p != LEA && *p != LL)) {
+            return last;
+        }
+        depth = depth - opt_pops(p);
+        if (depth < 0) {
+            return last;
+        }
+        p = p + 1 + operands(*p);
+        if (depth == 0 && p > s + 2) {
+            last = p;
+        }
+    }
+    return last;
+}
+
+// compute an expression of a loop that does not change in it once in
+// front of the loop, into a new frame slot t:
+//
+//   a: ... <expr> ...           <expr>
+//      J<cc> a        ===>      SL t
+//                            a: ... LL t ...
+//                               J<cc> a
+//
+// every copy of the expression in the loop is replaced, returns whether
+// anything moved
+int opt_hoist(int *start)
+{
+    int *ent, *p, *q, *s, *w, *top, *bottom;
+    int  len, slot;
+
+    opt_scan(start, text + 1);
+    ent = start;
+    while (ent <= text && *ent != ENT) {
+        ent = ent + 1 + operands(*ent);
+    }
+    if (ent > text) {
+        return 0;
+    }
+
+    // a backward jump closes a loop, which must be entered at its top
+    w = 0;
+    p = ent;
+    while (p <= text && !w) {
+        bottom = p + 1 + operands(*p);
+        if ((q = jump_operand(p)) && (top = (int *)*q) > ent && top <= p
+            && !opt_entered(start, text + 1, top, bottom)) {
+            s = top;
+            while (s < bottom && !(w = opt_invariant(start, text + 1, top, bottom, s))) {
+                s = s + 1 + operands(*s);
+            }
+        }
+        p = bottom;
+    }
+    if (!w) {
+        return 0;
+    }
+
+    len  = w - s;
+    slot = -(ent[1] + 1);
+    memcpy(opt_pos, s, len * sizeof(int));
+    opt_insert(start, top, bottom, len + 2);
+    memcpy(top, opt_pos, len * sizeof(int));
+    top[len]     = SL;
+    top[len + 1] = slot;
+    ent[1]       = ent[1] + 1;
+    top          = top + len + 2;
+    bottom       = bottom + len + 2;
+
+    opt_scan(start, text + 1);
+    p = top;
+    while (p < bottom) {
+        q = p;
+        while (q < p + len && (q == p || !(opt_flags[q - start] & O_LABEL))) {
+            q = q + 1 + operands(*q);
+        }
+        if (q == p + len && !memcmp(p, opt_pos, len * sizeof(int))) {
+            q = p + 2;
+            while (q < p + len) {
+                opt_delete(start, q);
+                q = q + 1 + operands(*q);
+            }
+            p[0] = LL;
+            p[1] = slot;
+            p    = p + len;
+        }
+        else {
+            p = p + 1 + operands(*p);
+        }
+    }
+    opt_compact(start, text + 1);
+    return 1;
+}
+
+// optimize the code of the function starting at start and ending at text:
+// constant folding, branches on constants, jump threading, addressing an
+// element read and written back once and removal of unreachable code,
+// then loop invariants are moved out of loops, repeated while anything changes
+void optimize_function(int *start)
+{
+    int rounds, changed;
+    rounds  = 0;
+    changed = 1;
+    while (changed && rounds < 16) {
+        opt_scan(start, text + 1);
+        changed = opt_rewrite(start, text + 1);
+        opt_unreachable(start, text + 1);
+        opt_compact(start, text + 1);
+        if (!changed) {
+            changed = opt_hoist(start);
+        }
+        rounds++;
+    }
+    last_cmp = 0;
+}
+
+void function_declaration()
+{
+    int *start;
+    if (tiered || profile) {
+        // count the calls, the function is promoted by the TICK at its entry
+        *++text = TICK;
+        *++text = (int)function_id;
+    }
+    start             = text + 1;
+    last_local        = locals;
+    function_id[Data] = (int)data;   // its string literals follow
+    match('(');
+    function_parameter();
+    match(')');
+    match('{');
+    function_body();
+    if (opt_level) {
+        optimize_function(start);
+    }
+
+    // unbind local variable declarations for all local variables
+    // prevent local variable cover global variable
+    while (last_local > locals) {
+        current_id        = (int *)*last_local--;
+        current_id[Class] = current_id[BClass];
+        current_id[Type]  = current_id[BType];
+        current_id[Value] = current_id[BValue];
+    }
+}
+
+// skip a function from its parameter list to the '}' closing its body,
+// braces are matched on the raw source so nothing is lexed or emitted
+void skip_function()
+{
+    int depth;
+    int quote;
+    depth = 0;
+    while (*src) {
+        if (*src == '\n') {
+            ++line;
+        }
+        else if (*src == '"' || *src == '\'') {
+            quote = *src++;
+            while (*src != 0 && *src != quote) {
+                if (*src == '\\' && src[1] != 0) {
+                    src++;
+                }
+                src++;
+            }
+        }
+        else if (*src == '#' || (*src == '/' && src[1] == '/')) {
+            // stop just before the newline so that it is still counted
+            if (!(src = memchr(src, '\n', src_end - src))) {
+                src = src_end;
+            }
+            src--;
+        }
+        else if (*src == '{') {
+            ++depth;
+        }
+        else if (*src == '}' && --depth == 0) {
+            src++;
+            token = '}';
+            return;
+        }
+        src++;
+    }
+    printf("%d: unexpected end of file in function\n", line);
+    exit(-1);
+}
+
+void lazy_declaration()
+{
+    // record where the function starts and leave a stub in its place:
+    //
+    //   LAZY <id>    ==first call==>    JMP <body>
+    //
+    // the body is compiled by lazy_compile() when the stub is first executed
+    current_id[Src]   = (int)(src - 1);   // the '(' of the parameter list
+    current_id[Line]  = line;
+    current_id[Value] = (int)(text + 1);
+    *++text           = LAZY;
+    *++text           = (int)current_id;
+    skip_function();
+}
+
+// compile a lazily declared function and patch its stub, return the entry point
+int *lazy_compile(int *id, int *stub)
+{
+    int *entry;
+
+    src  = (char *)id[Src];
+    line = id[Line];
+    next();
+
+    entry       = text + 1;
+    id[Value]   = (int)entry;
+    function_id = id;
+    function_declaration();
+
+    stub[0] = JMP;
+    stub[1] = (int)entry;
+    return entry;
+}
+
+// recompile a hot function with -O2, its old entry jumps to the new code
+// so that the frames still running the old code finish there
+int *promote(int *id, int *entry)
+{
+    int old_level;
+    char *old_data;
+    old_level = opt_level;
+    old_data  = data;
+    opt_level = 2;
+    tiered    = 0;
+    promoting = 1;
+    data      = (char *)id[Data];   // the new code uses the literals of the old
+    entry     = lazy_compile(id, entry);
+    data      = old_data;
+    promoting = 0;
+    tiered    = 1;
+    opt_level = old_level;
+    return entry;
+}
+
+void global_declaration()
+{
+    // global_declaration ::= enum_decl | variable_decl | function_decl
+    //
+    // enum_decl ::= 'enum' [id] '{' id ['=' 'num'] {',' id ['=' 'num'} '}'
+    //
+    // variable_decl ::= type {'*'} id { ',' {'*'} id } ';'
+    //
+    // function_decl ::= type {'*'} id '(' parameter_decl ')' '{' body_decl '}'
+
+
+    int type;   // tmp, actual type for variable
+    int i;      // tmp
+    basetype = INT;
+
+    // parse Enum
+    if (token == Enum) {
+        // enum [id] { a = 10, b = 20, ...}
+        match(Enum);
+        if (token != '{') {
+            match(Id);
+        }
+        if (token == '{') {
+            match('{');
+            enum_declaration();
+            match('}');
+        }
+        match(';');
+        return;
+    }
+
+    // parse variable and function
+
+    // parse type information
+    if (token == Int) {
+        match(Int);
+        basetype = INT;
+    }
+    else if (token == Char) {
+        match(Char);
+        basetype = CHAR;
+    }
+
+    // parse the comma seperated variable declaration.
+    while (token != ';' && token != '}') {
+        type = basetype;
+        // parse pointer type, note that there may exist `int ****x;`
+        while (token == Mul) {
+            match(Mul);
+            type = type + PTR;
+        }
+        if (token != Id) {
+            // invalid declaration
+            printf("%d: bad global declaration\n", line);
+            exit(-1);
+        }
+        if (current_id[Class]) {
+            // identifier exists
+            printf("%d: duplicate global declaration\n", line);
+            exit(-1);
+        }
+        match(Id);
+        current_id[Type] = type;
+
+        if (token == '(') {
+            // function
+            current_id[Class] = Fun;
+            if (lazy) {
+                lazy_declaration();
+            }
+            else {
+                current_id[Src]   = (int)(src - 1);    // to compile it again when --tiered
+                current_id[Line]  = line;
+                current_id[Value] = (int)(text + 1);   // memory address of function
+                function_id       = current_id;
+                function_declaration();
+            }
+        }
+        else {
+            // global variable
+            current_id[Class] = Glo;
+            current_id[Value] = (int)data;   // assign memory address
+            data              = data + sizeof(int);
+        }
+        if (token == ',') {
+            match(',');
+        }
+    }
+    next();
+}
+
+// program entry
+void program()
+{
+    next();
+    while (token > 0) {
+        global_declaration();
+    }
+}
+
+// read() for interpreted programs, small reads are served from a per-fd buffer
+// so that a script reading a few bytes at a time does not pay a syscall each
+int buffered_read(int fd, char *buf, int size)
+{
+    int avail;
+    if (fd < 0 || fd >= FD_MAX) {
+        return read(fd, buf, size);
+    }
+
+    avail = fd_end[fd] - fd_pos[fd];
+    if (avail == 0) {
+        if (size >= FD_BUFSIZE) {
+            // large reads go straight to the caller's buffer
+            return read(fd, buf, size);
+        }
+        if (!fd_buf[fd] && !(fd_buf[fd] = (int)malloc(FD_BUFSIZE))) {
+            return read(fd, buf, size);
+        }
+        if ((avail = read(fd, (char *)fd_buf[fd], FD_BUFSIZE)) <= 0) {
+            return avail;
+        }
+        fd_pos[fd] = fd_buf[fd];
+        fd_end[fd] = fd_buf[fd] + avail;
+    }
+
+    if (size > avail) {
+        size = avail;
+    }
+    memcpy(buf, (char *)fd_pos[fd], size);
+    fd_pos[fd] = fd_pos[fd] + size;
+    return size;
+}
+
+// drop whatever is buffered for fd, its number may be reused by the next open()
+void buffered_reset(int fd)
+{
+    if (fd >= 0 && fd < FD_MAX) {
+        fd_pos[fd] = fd_end[fd] = 0;
+    }
+}
+
+// virtual machine entry
+// write value as a variable-length operand of at least size bytes, 7 bits
+// a byte with the low ones first and the high bit set on all but the last,
+// whose bit 6 is the sign, returns the byte after it
+char *encode_operand(char *p, int value, int size)
+{
+    size--;
+    while (value < -64 || value > 63 || size > 0) {
+        *p++  = (value & 127) | 128;
+        value = value >> 7;
+        size--;
+    }
+    *p++ = value & 127;
+    return p;
+}
+
+int operand_size(int value)
+{
+    int size;
+    size = 1;
+    while (value < -64 || value > 63) {
+        value = value >> 7;
+        size++;
+    }
+    return size;
+}
+
+// read a variable-length operand at cpc, the bytes are masked so that it
+// does not matter whether char is signed, and the value is built from its
+// last byte, which holds the sign, back to its first so nothing overflows
+int decode()
+{
+    int value, b;
+    char *first, *last;
+    b = *cpc & 255;
+    if (b < 128) {
+        // most operands fit in one byte
+        cpc++;
+        return (b & 64) ? b - 128 : b;
+    }
+    first = cpc;
+    last  = cpc;
+    while (*last & 128) {
+        last++;
+    }
+    cpc   = last + 1;
+    value = *last & 63;
+    if (*last & 64) {
+        value = value - 64;
+    }
+    while (last > first) {
+        last--;
+        value = value * 128 + (*last & 127);
+    }
+    return value;
+}
+
+// the value of operand i of the instruction at p in the byte encoding,
+// start is the first instruction of text
+int encoded_operand(int *start, int *p, int i)
+{
+    int *target;
+    target = (int *)p[i];
+    if (p + i == jump_operand(p) || (*p == CALL && i == 1)) {
+        // relative to the end of the instruction
+        return code_pos[target - start] - code_pos[p - start] - code_size[p - start];
+    }
+    return p[i];
+}
+
+// the code address of a jump table entry
+int encoded_target(int *start, int target)
+{
+    return (int)(code + code_pos[(int *)target - start]);
+}
+
+// encode the whole program into code, returning its size in bytes; the
+// instruction sizes grow until every relative jump fits
+int encode_program()
+{
+    int *start, *p, *q;
+    int  size, pos, changed, i;
+
+    start = old_text + 1;
+    p     = start;
+    while (p <= text) {
+        code_size[p - start] = 1 + operands(*p);
+        p                    = p + 1 + operands(*p);
+    }
+    changed = 1;
+    while (changed) {
+        changed = 0;
+        pos     = 0;
+        p       = start;
+        while (p <= text) {
+            code_pos[p - start] = pos;
+            pos                 = pos + code_size[p - start];
+            p                   = p + 1 + operands(*p);
+        }
+        code_pos[p - start] = pos;
+        p                   = start;
+        while (p <= text) {
+            size = 1;
+            i    = 1;
+            while (i <= operands(*p)) {
+                size = size + operand_size(encoded_operand(start, p, i));
+                i++;
+            }
+            if (size > code_size[p - start]) {
+                code_size[p - start] = size;
+                changed              = 1;
+            }
+            p = p + 1 + operands(*p);
+        }
+    }
+
+    p = start;
+    while (p <= text) {
+        cpc    = code + code_pos[p - start];
+        *cpc++ = *p;
+        size   = code_size[p - start] - 1;
+        i      = 1;
+        while (i <= operands(*p)) {
+            // the last operand takes the bytes the others leave
+            pos  = (i == operands(*p)) ? size : operand_size(encoded_operand(start, p, i));
+            cpc  = encode_operand(cpc, encoded_operand(start, p, i), pos);
+            size = size - pos;
+            i++;
+        }
+        if (*p == JTAB || *p == JBIN) {
+            q = (int *)p[1];
+            if (*p == JTAB) {
+                i = 2;
+                while (i <= 3 + q[1] - q[0]) {
+                    q[i] = encoded_target(start, q[i]);
+                    i++;
+                }
+            }
+            else {
+                q[1] = encoded_target(start, q[1]);
+                i    = 0;
+                while (i < q[0]) {
+                    q[3 + i * 2] = encoded_target(start, q[3 + i * 2]);
+                    i++;
+                }
+            }
+        }
+        p = p + 1 + operands(*p);
+    }
+    return code_pos[p - start];
+}
+
+// run the builtin function op on the arguments at sp, n is the argument
+// count, which only PRTF needs
+int builtin(int op, int n)
+{
+    int *tmp, fd;
+
+    if (op == OPEN) {
+        tmp = sp + n;   // the mode is only used with O_CREAT
+        fd  = open((char *)tmp[-1], tmp[-2], tmp[-3]);
+        buffered_reset(fd);
+        return fd;
+    }
+    if (op == CLOS) {
+        buffered_reset(*sp);
+        return close(*sp);
+    }
+    if (op == READ) {
+        return buffered_read(sp[2], (char *)sp[1], *sp);
+    }
+    if (op == PRTF) {
+        tmp = sp + n;
+        return printf((char *)tmp[-1], tmp[-2], tmp[-3], tmp[-4], tmp[-5], tmp[-6]);
+    }
+    if (op == DPRF) {
+        tmp = sp + n;
+        return dprintf(tmp[-1], (char *)tmp[-2], tmp[-3], tmp[-4], tmp[-5], tmp[-6], tmp[-7]);
+    }
+    if (op == CLKT) {
+        return clock_gettime(sp[1], (void *)sp[0]);
+    }
+    if (op == WRIT) {
+        return write(sp[2], (char *)sp[1], *sp);
+    }
+    if (op == MALC) {
+        return (int)malloc(*sp);
+    }
+    if (op == MSET) {
+        return (int)memset((char *)sp[2], sp[1], sp[0]);
+    }
+    if (op == MCMP) {
+        return memcmp((char *)sp[2], (char *)sp[1], sp[0]);
+    }
+    // the byte loops are left to libc, which already picks an SSE2/AVX2 kernel
+    // for the running cpu, so one dispatched instruction moves the whole buffer
+    if (op == MCPY) {
+        return (int)memcpy((char *)sp[2], (char *)sp[1], sp[0]);
+    }
+    if (op == MMOV) {
+        return (int)memmove((char *)sp[2], (char *)sp[1], sp[0]);
+    }
+    if (op == SLEN) {
+        return strlen((char *)*sp);
+    }
+    if (op == MCHR) {
+        return (int)memchr((char *)sp[2], sp[1], sp[0]);
+    }
+    if (op == SCMP) {
+        return strcmp((char *)sp[1], (char *)sp[0]);
+    }
+    if (op == SYSC) {
+        // syscall(number, ...) for the kernel interfaces libc has no wrapper for
+        tmp = sp + n;
+        return syscall(tmp[-1], tmp[-2], tmp[-3], tmp[-4], tmp[-5], tmp[-6]);
+    }
+    if (op == MMAP) {
+        // mmap(addr, length, prot, flags, fd, offset), a PROT_READ/MAP_PRIVATE (1/2)
+        // mapping lets a script scan a whole file without read() or copies
+        return (int)mmap((char *)sp[5], sp[4], sp[3], sp[2], sp[1], sp[0]);
+    }
+    return munmap((char *)sp[1], sp[0]);   // MUNM
+}
+
+// length of an identifier, names of the symbol table point into the source
+int name_length(char *name)
+{
+    int len;
+
+    len = 0;
+    while (char_class[name[len] & 255] & (C_IDENT | C_DIGIT)) {
+        len++;
+    }
+    return len;
+}
+
+// the function whose code holds p, 0 outside of text
+int *prof_function(int *p)
+{
+    int *id, *best;
+
+    if (p < old_text || p >= text) {
+        return 0;
+    }
+    if (!prof_func[p - old_text]) {
+        // the function with the last entry before p
+        best = 0;
+        id   = symbols;
+        while (id < symbols_end) {
+            if (id[Class] == Fun && id[Value] <= (int)p && (!best || id[Value] > best[Value])) {
+                best = id;
+            }
+            id = id + IdSize;
+        }
+        prof_func[p - old_text] = (int)best;
+    }
+    return (int *)prof_func[p - old_text];
+}
+
+// whether op jumps or falls through depending on ax or the stack
+int is_branch(int op)
+{
+    return op == JZ || op == JNZ || (op >= JEQ && op <= JGEI);
+}
+
+// count the instruction at pc and whether the branch before it jumped
+void pgo_record()
+{
+    if (pc > text) {
+        return;   // the exit stub
+    }
+    if (pgo_last && pc != pgo_last + 1 + operands(*pgo_last)) {
+        pgo_taken[pgo_last - old_text]++;
+    }
+    pgo_count[pc - old_text]++;
+    pgo_last = is_branch(*pc) ? pc : 0;
+}
+
+// count the current stack, walking the bp and return pc pairs left by CALL and ENT
+void prof_sample()
+{
+    int *stack_ids, *frame, *e, *f;
+    int  depth, hash, i;
+
+    if (!profile) {
+        prof_left = 1 << 30;
+        return;
+    }
+    prof_left = PROF_PERIOD;
+
+    // collect the functions, innermost first, past the end of prof_stacks
+    stack_ids = prof_end + 3;
+    if ((char *)(stack_ids + PROF_DEPTH) > (char *)prof_stacks + poolsize) {
+        prof_dropped++;
+        return;
+    }
+    depth = 0;
+    if ((f = prof_function(pc))) {
+        stack_ids[depth++] = (int)f;
+    }
+    if (*pc == ENT && (f = prof_function((int *)*sp))) {
+        stack_ids[depth++] = (int)f;   // the TICK at an entry runs before ENT saves the caller's frame
+    }
+    frame = bp;
+    while (frame < stack_top && depth < PROF_DEPTH) {
+        if ((f = prof_function((int *)frame[1]))) {
+            stack_ids[depth++] = (int)f;
+        }
+        frame = (int *)*frame;
+    }
+
+    hash = depth;
+    i    = 0;
+    while (i < depth) {
+        hash = hash * 31 + stack_ids[i++];
+    }
+    hash = hash & (PROF_BUCKETS - 1);
+    e    = (int *)prof_buckets[hash];
+    while (e) {
+        if (e[2] == depth && !memcmp(e + 3, stack_ids, depth * sizeof(int))) {
+            e[1]++;
+            return;
+        }
+        e = (int *)*e;
+    }
+    prof_end[0]          = prof_buckets[hash];
+    prof_end[1]          = 1;
+    prof_end[2]          = depth;
+    prof_buckets[hash]   = (int)prof_end;
+    prof_end             = stack_ids + depth;
+}
+
+// write one `main;caller;callee count` line per distinct stack
+int prof_write()
+{
+    int  fd, i;
+    int *e, *id;
+
+    if ((fd = open(prof_file, 577, 420)) < 0) {   // O_WRONLY | O_CREAT | O_TRUNC, 0644
+        printf("could not open(%s)\n", prof_file);
+        return -1;
+    }
+    e = prof_stacks;
+    while (e < prof_end) {
+        i = e[2];
+        while (i > 0) {
+            id = (int *)e[2 + i];
+            dprintf(fd, i == 1 ? "%.*s" : "%.*s;", name_length((char *)id[Name]), (char *)id[Name]);
+            i--;
+        }
+        dprintf(fd, " %d\n", e[1]);
+        e = e + 3 + e[2];
+    }
+    if (prof_dropped) {
+        printf("profile: %d samples dropped, the stack table is full\n", prof_dropped);
+    }
+    close(fd);
+    return 0;
+}
+
+// mnemonic of an instruction, padded to 5 characters
+char *op_name(int op)
+{
+    return "LEA  IMM  LL   SL   INCL JMP  CALL JZ   JNZ  JEQ  JNE  JLT  JGT  JLE  JGE  "
+           "JEQI JNEI JLTI JGTI JLEI JGEI JTAB JBIN ENT  ADJ  LEV  LI   LC   SI   SC   "
+           "LIX  LCX  SIX  SCX  IXA  PUSH OR   XOR  AND  EQ   NE   LT   GT   LE   GE   "
+           "SHL  SHR  ADD  SUB  MUL  DIV  MOD  ADDI SHLI SHRI MULI DIVI DIVS MODI LAZY "
+           "TICK TICKLOPEN READ CLOS PRTF MALC MSET MCMP MCPY MMOV SLEN MCHR SCMP SYSC "
+           "DPRF CLKT WRIT MMAP MUNM EXIT " + op * 5;
+}
+
+void trace_table()
+{
+    int *id, *p;
+    int  len;
+
+    p                      = trace_ring_end;
+    trace_map[TrText]      = text - old_text;
+    trace_map[TrFunctions] = 0;
+    id                     = symbols;
+    while (id < symbols_end) {
+        if (id[Class] == Fun) {
+            len = name_length((char *)id[Name]);
+            if (p + 2 + len / sizeof(int) + 1 > trace_ring_end + TRACE_TABLE) {
+                return;
+            }
+            p[0] = (int *)id[Value] - old_text;
+            p[1] = len;
+            memcpy(p + 2, (char *)id[Name], len);
+            p = p + 2 + len / sizeof(int) + 1;
+            trace_map[TrFunctions]++;
+        }
+        id = id + IdSize;
+    }
+}
+
+int trace_open()
+{
+    int   fd, size;
+    char *zero;
+
+    size = (TrHeader + TRACE_RECORDS * 3 + TRACE_TABLE) * sizeof(int);
+    if ((fd = open(trace_file, 578, 420)) < 0) {   // O_RDWR | O_CREAT | O_TRUNC, 0644
+        printf("could not open(%s)\n", trace_file);
+        return -1;
+    }
+    if (!(zero = malloc(size))) {
+        printf("could not malloc(%d) for the trace\n", size);
+        return -1;
+    }
+    memset(zero, 0, size);
+    if (write(fd, zero, size) != size || (trace_map = (int *)mmap(0, size, 3, 1, fd, 0)) == (int *)-1) {
+        printf("could not map %s\n", trace_file);   // PROT_READ | PROT_WRITE, MAP_SHARED
+        return -1;
+    }
+    close(fd);
+
+    trace_map[TrMagic]    = TRACE_MAGIC;
+    trace_map[TrWordSize] = sizeof(int);
+    trace_map[TrBase]     = (int)(trace_map + TrHeader);
+    trace_map[TrNext]     = trace_map[TrBase];
+    trace_pos             = trace_map + TrHeader;
+    trace_ring_end        = trace_pos + TRACE_RECORDS * 3;
+    trace_table();
+    return 0;
+}
+
+// the functions of --lazy and --tiered moved while running
+void trace_close(int value)
+{
+    trace_table();
+    trace_map[TrExit] = value;
+    trace_map[TrDone] = 1;
+    munmap((char *)trace_map, (TrHeader + TRACE_RECORDS * 3 + TRACE_TABLE) * sizeof(int));
+}
+
+// print the records of a --trace file, oldest first
+int trace_decode(char *file)
+{
+    int  fd, n, i, best, len;
+    int *map, *r, *f, *p, *next;
+
+    if ((fd = open(file, 0)) < 0) {
+        printf("could not open(%s)\n", file);
+        return -1;
+    }
+    map = (int *)mmap(0, (TrHeader + TRACE_RECORDS * 3 + TRACE_TABLE) * sizeof(int), 1, 2, fd, 0);
+    close(fd);
+    if (map == (int *)-1 || map[TrMagic] != TRACE_MAGIC || map[TrWordSize] != sizeof(int)) {
+        printf("%s is not a trace of this xc\n", file);
+        return -1;
+    }
+
+    next = map + TrHeader + (map[TrNext] - map[TrBase]) / sizeof(int);
+    r    = map[TrWrapped] ? next : map + TrHeader;
+    n    = map[TrWrapped] ? TRACE_RECORDS : (next - r) / 3;
+    if (map[TrDone]) {
+        printf("last %d instructions, exit(%d)\n", n, map[TrExit]);
+    }
+    else {
+        printf("last %d instructions, the run did not finish\n", n);
+    }
+
+    i = -n;
+    while (i < 0) {
+        if (r == map + TrHeader + TRACE_RECORDS * 3) {
+            r = map + TrHeader;
+        }
+
+        // the function with the last entry before pc
+        best = -1;
+        f    = 0;
+        p    = map + TrHeader + TRACE_RECORDS * 3;
+        len  = map[TrFunctions];
+        while (len-- > 0) {
+            if (p[0] <= (r[0] >> 8) && p[0] > best) {
+                best = p[0];
+                f    = p;
+            }
+            p = p + 2 + p[1] / sizeof(int) + 1;
+        }
+
+        printf("%6d %6d ", i + 1, r[0] >> 8);
+        if ((r[0] >> 8) > map[TrText]) {
+            printf("<exit stub> ");
+        }
+        else if (f) {
+            printf("%.*s+%-4d ", f[1], (char *)(f + 2), (r[0] >> 8) - best);
+        }
+        else {
+            printf("? ");
+        }
+        printf("%.5s ax=%d sp=%d\n", op_name(r[0] & 255), r[1], r[2]);
+        r = r + 3;
+        i++;
+    }
+    return 0;
+}
+
+// replace each instruction of [p, end] by HOOK
+void hook_patch(int *p, int *end)
+{
+    while (p <= end) {
+        hook_shadow[p - old_text] = *p;
+        *p                        = HOOK;
+        p                         = p + 1 + operands(hook_shadow[p - old_text]);
+    }
+}
+
+// put the instructions back once the program ended
+void hook_unpatch()
+{
+    int *p;
+    p = old_text + 1;
+    while (p <= hook_end) {
+        if (*p == HOOK) {
+            *p = hook_shadow[p - old_text];
+        }
+        p = p + 1 + operands(*p);
+    }
+    hook_end = 0;
+}
+
+// hook the code compiled while running, and the stub that now jumps to it
+// unless it is the instruction being run
+void hook_compiled(int *stub)
+{
+    if (hook_end) {
+        if (stub != hook_prev) {
+            hook_patch(stub, stub);
+        }
+        hook_patch(hook_end + 1, text);
+        hook_end = text;
+    }
+}
+
+int eval()
+{
+    int op, *tmp, *stub;
+    int lo, hi, mid;
+    while (1) {
+        op = *pc++;
+
+        // MOV
+        if (op == IMM) {
+            // load immediate value to ax
+            ax = *pc++;
+        }
+        else if (op == LL) {
+            // load the local at frame slot <offset>
+            ax = *(bp + *pc++);
+        }
+        else if (op == SL) {
+            // save ax to the local at frame slot <offset>
+            *(bp + *pc++) = ax;
+        }
+        else if (op == INCL) {
+            // add <step> to the local at frame slot <offset>, load the result
+            ax = *(bp + *pc) = *(bp + *pc) + pc[1];
+            pc = pc + 2;
+        }
+        else if (op == LC) {
+            // load character to ax, address in ax
+            ax = *(char *)ax;
+        }
+        else if (op == LI) {
+            // load integer to ax, address in ax
+            ax = *(int *)ax;
+        }
+        else if (op == SC) {
+            // save character to address, value in ax, address on stack
+            ax = *(char *)*sp++ = ax;
+        }
+        else if (op == SI) {
+            // save integer to address, value in ax, address on stack
+            *(int *)*sp++ = ax;
+        }
+        else if (op == LIX) {
+            // load integer at base + index * sizeof(int), base on stack, index in ax
+            ax = *((int *)*sp++ + ax);
+        }
+        else if (op == LCX) {
+            // load character at base + index, base on stack, index in ax
+            ax = *((char *)*sp++ + ax);
+        }
+        else if (op == SIX) {
+            // save integer at base + index * sizeof(int), value in ax, index and base on stack
+            *((int *)sp[1] + *sp) = ax;
+            sp = sp + 2;
+        }
+        else if (op == SCX) {
+            // save character at base + index, value in ax, index and base on stack
+            ax = *((char *)sp[1] + *sp) = ax;
+            sp = sp + 2;
+        }
+        else if (op == IXA) {
+            // address of base + index * sizeof(int), base on stack, index in ax
+            ax = (int)((int *)*sp++ + ax);
+        }
+
+        // PUSH
+        else if (op == PUSH) {
+            // push the value of ax into the stack
+            *--sp = ax;
+        }
+
+        // JMP <addr>
+        else if (op == JMP) {
+            // jump to the address
+            pc = (int *)*pc;
+        }
+
+        // JGE, CMPL
+        else if (op == JZ) {
+            // jump if ax is zero
+            pc = ax ? pc + 1 : (int *)*pc;
+        }
+        else if (op == JNZ) {
+            // jump if ax is not zero
+            pc = ax ? (int *)*pc : pc + 1;
+        }
+
+        // J<cc> <addr>, J<cc>I <value> <addr>
+        // compare the stack top (or ax) with ax (or value) and jump if <cc>
+        // holds, leaving ax 0 on the jump and 1 otherwise
+        // clang-format off
+        else if (op == JEQ) { ax = *sp++ != ax; pc = ax ? pc + 1 : (int *)*pc; }
+        else if (op == JNE) { ax = *sp++ == ax; pc = ax ? pc + 1 : (int *)*pc; }
+        else if (op == JLT) { ax = *sp++ >= ax; pc = ax ? pc + 1 : (int *)*pc; }
+        else if (op == JGT) { ax = *sp++ <= ax; pc = ax ? pc + 1 : (int *)*pc; }
+        else if (op == JLE) { ax = *sp++ > ax;  pc = ax ? pc + 1 : (int *)*pc; }
+        else if (op == JGE) { ax = *sp++ < ax;  pc = ax ? pc + 1 : (int *)*pc; }
+        else if (op == JEQI) { ax = ax != *pc; pc = ax ? pc + 2 : (int *)pc[1]; }
+        else if (op == JNEI) { ax = ax == *pc; pc = ax ? pc + 2 : (int *)pc[1]; }
+        else if (op == JLTI) { ax = ax >= *pc; pc = ax ? pc + 2 : (int *)pc[1]; }
+        else if (op == JGTI) { ax = ax <= *pc; pc = ax ? pc + 2 : (int *)pc[1]; }
+        else if (op == JLEI) { ax = ax > *pc;  pc = ax ? pc + 2 : (int *)pc[1]; }
+        else if (op == JGEI) { ax = ax < *pc;  pc = ax ? pc + 2 : (int *)pc[1]; }
+        // clang-format on
+
+        // JTAB <table>
+        else if (op == JTAB) {
+            // switch on ax through [min, max, default, address...]
+            tmp = (int *)*pc;
+            pc  = (int *)((ax >= tmp[0] && ax <= tmp[1]) ? tmp[3 + ax - tmp[0]] : tmp[2]);
+        }
+
+        // JBIN <table>
+        else if (op == JBIN) {
+            // switch on ax, binary search [count, default, value, address, ...]
+            tmp = (int *)*pc;
+            lo  = 0;
+            hi  = tmp[0];
+            while (lo < hi) {
+                mid = (lo + hi) / 2;
+                if (tmp[2 + mid * 2] < ax) {
+                    lo = mid + 1;
+                }
+                else {
+                    hi = mid;
+                }
+            }
+            pc = (int *)((lo < tmp[0] && tmp[2 + lo * 2] == ax) ? tmp[3 + lo * 2] : tmp[1]);
+        }
+
+        // CALL
+        else if (op == CALL) {
+            // call subroutine
+            *--sp = (int)(pc + 1);   // push pc to stack
+            pc    = (int *)*pc;      // jump
+        }
+
+        // ENT <size>
+        else if (op == ENT) {
+            // make new stack frame
             *--sp = (int)bp;      // push ebp
             bp    = sp;           // mov ebp, esp
             sp    = sp - *pc++;   // sub <size>, esp // space for variable
         }
 
-        // ADJ <size>
-        else if (op == ADJ) {
-            // remove arguments from frame
-            sp = sp + *pc++;   // add esp, <size>
+        // ADJ <size>
+        else if (op == ADJ) {
+            // remove arguments from frame
+            sp = sp + *pc++;   // add esp, <size>
+        }
+
+        // mov + pop + ret
+        // LEV
+        else if (op == LEV) {
+            // leave current frame, restore call frame and pc
+            sp = bp;             // mov esp, ebp
+            bp = (int *)*sp++;   // pop ebp
+            pc = (int *)*sp++;   // ret
+        }
+
+        // LEA <offset>
+        else if (op == LEA) {
+            // load address for argument
+            ax = (int)(bp + *pc++);
+        }
+
+        // operators
+        // clang-format off
+        else if (op == OR) ax = *sp++ | ax;
+        else if (op == XOR) ax = *sp++ ^ ax;
+        else if (op == AND) ax = *sp++ & ax;
+        else if (op == EQ) ax = *sp++ == ax;
+        else if (op == NE) ax = *sp++ != ax;
+        else if (op == LT) ax = *sp++ < ax;
+        else if (op == LE) ax = *sp++ <= ax;
+        else if (op == GT) ax = *sp++ > ax;
+        else if (op == GE) ax = *sp++ >= ax;
+        else if (op == SHL) ax = *sp++ << ax;
+        else if (op == SHR) ax = *sp++ >> ax;
+        else if (op == ADD) ax = *sp++ + ax;
+        else if (op == SUB) ax = *sp++ - ax;
+        else if (op == MUL) ax = *sp++ * ax;
+        else if (op == DIV) ax = *sp++ / ax;
+        else if (op == MOD) ax = *sp++ % ax;
+
+        // the same with the right operand as immediate, DIVS <n> divides
+        // by 1 << n rounding towards zero like DIV
+        else if (op == ADDI) ax = ax + *pc++;
+        else if (op == SHLI) ax = ax << *pc++;
+        else if (op == SHRI) ax = ax >> *pc++;
+        else if (op == MULI) ax = ax * *pc++;
+        else if (op == DIVI) ax = ax / *pc++;
+        else if (op == DIVS) { ax = (ax < 0 ? ax + (1 << *pc) - 1 : ax) >> *pc; pc++; }
+        else if (op == MODI) ax = ax % *pc++;
+        // clang-format on
+
+        // builtin function
+        else if (op == EXIT) {
+            printf("exit(%d)", *sp);
+            return *sp;
+        }
+        else if (op >= OPEN && op <= MUNM) {
+            ax = builtin(op, pc[1]);   // PRTF needs the count of the following ADJ
+        }
+
+        // LAZY <id>
+        else if (op == LAZY) {
+            // first call of a function declared with --lazy, compile it now
+            stub = pc - 1;
+            pc   = lazy_compile((int *)*pc, stub);
+            hook_compiled(stub);
+        }
+        else if (op == TICK) {
+            // entry of a function compiled --tiered or --profile, promote it once hot
+            tmp = (int *)*pc++;
+            if (--prof_left <= 0) {
+                prof_sample();
+            }
+            if (++tmp[Count] == TIER_THRESHOLD && tiered) {
+                stub = pc - 2;
+                pc   = promote(tmp, stub);
+                hook_compiled(stub);
+            }
+        }
+        else if (op == TICKL) {
+            // an iteration of one of its loops, once hot the next call runs
+            // the promoted code while this one finishes the loop here
+            tmp = (int *)*pc++;
+            if (--prof_left <= 0) {
+                prof_sample();
+            }
+            if (++tmp[Count] == TIER_THRESHOLD && tiered) {
+                stub = (int *)tmp[Value];
+                promote(tmp, stub);
+                hook_compiled(stub);
+            }
+        }
+
+        // HOOK, in place of every instruction with --trace or --write-profile
+        else if (op == HOOK) {
+            // put the instruction back to run it next and record it, then
+            // HOOK goes back on the one run before, which LAZY and TICK
+            // may have turned into a JMP
+            pc  = pc - 1;
+            *pc = hook_shadow[pc - old_text];
+            if (trace) {
+                trace_pos[0] = (pc - old_text) << 8 | *pc;
+                trace_pos[1] = ax;
+                trace_pos[2] = stack_top - sp;
+                trace_pos    = trace_pos + 3;
+                if (trace_pos == trace_ring_end) {
+                    trace_pos            = trace_map + TrHeader;
+                    trace_map[TrWrapped] = 1;
+                }
+                trace_map[TrNext] = (int)trace_pos;
+            }
+            else {
+                pgo_record();
+            }
+            if (hook_prev && hook_prev != pc) {
+                hook_shadow[hook_prev - old_text] = *hook_prev;
+                *hook_prev                        = HOOK;
+            }
+            hook_prev = pc;
+        }
+
+        // others
+        else {
+            printf("unknown instruction: %d\n", op);
+            return -1;
+        }
+    }
+}
+
+// the VM loop for the byte encoding made by encode_program()
+int eval_compact()
+{
+    int   op, *tmp, a, b;
+    int   lo, hi, mid;
+    char *save;
+    while (1) {
+        op = *cpc++;
+
+        // clang-format off
+        if (op == IMM) ax = decode();
+        else if (op == LL) ax = *(bp + decode());
+        else if (op == SL) *(bp + decode()) = ax;
+        else if (op == INCL) { a = decode(); b = decode(); ax = *(bp + a) = *(bp + a) + b; }
+        else if (op == LC) ax = *(char *)ax;
+        else if (op == LI) ax = *(int *)ax;
+        else if (op == SC) ax = *(char *)*sp++ = ax;
+        else if (op == SI) *(int *)*sp++ = ax;
+        else if (op == LIX) ax = *((int *)*sp++ + ax);
+        else if (op == LCX) ax = *((char *)*sp++ + ax);
+        else if (op == SIX) { *((int *)sp[1] + *sp) = ax; sp = sp + 2; }
+        else if (op == SCX) { ax = *((char *)sp[1] + *sp) = ax; sp = sp + 2; }
+        else if (op == IXA) ax = (int)((int *)*sp++ + ax);
+        else if (op == PUSH) *--sp = ax;
+
+        // jumps are relative to the end of their instruction
+        else if (op == JMP) { a = decode(); cpc = cpc + a; }
+        else if (op == JZ) { a = decode(); if (!ax) cpc = cpc + a; }
+        else if (op == JNZ) { a = decode(); if (ax) cpc = cpc + a; }
+        else if (op >= JEQ && op <= JGE) {
+            a  = decode();
+            b  = *sp++;
+            if (op == JEQ) ax = b != ax;
+            else if (op == JNE) ax = b == ax;
+            else if (op == JLT) ax = b >= ax;
+            else if (op == JGT) ax = b <= ax;
+            else if (op == JLE) ax = b > ax;
+            else ax = b < ax;
+            if (!ax) cpc = cpc + a;
+        }
+        else if (op >= JEQI && op <= JGEI) {
+            b  = decode();
+            a  = decode();
+            if (op == JEQI) ax = ax != b;
+            else if (op == JNEI) ax = ax == b;
+            else if (op == JLTI) ax = ax >= b;
+            else if (op == JGTI) ax = ax <= b;
+            else if (op == JLEI) ax = ax > b;
+            else ax = ax < b;
+            if (!ax) cpc = cpc + a;
+        }
+        // clang-format on
+
+        else if (op == JTAB) {
+            tmp = (int *)decode();
+            cpc = (char *)((ax >= tmp[0] && ax <= tmp[1]) ? tmp[3 + ax - tmp[0]] : tmp[2]);
+        }
+        else if (op == JBIN) {
+            tmp = (int *)decode();
+            lo  = 0;
+            hi  = tmp[0];
+            while (lo < hi) {
+                mid = (lo + hi) / 2;
+                if (tmp[2 + mid * 2] < ax) {
+                    lo = mid + 1;
+                }
+                else {
+                    hi = mid;
+                }
+            }
+            cpc = (char *)((lo < tmp[0] && tmp[2 + lo * 2] == ax) ? tmp[3 + lo * 2] : tmp[1]);
+        }
+        else if (op == CALL) {
+            a     = decode();
+            *--sp = (int)cpc;
+            cpc   = cpc + a;
+        }
+        else if (op == ENT) {
+            a     = decode();
+            *--sp = (int)bp;
+            bp    = sp;
+            sp    = sp - a;
+        }
+        else if (op == ADJ) {
+            sp = sp + decode();
+        }
+        else if (op == LEV) {
+            sp  = bp;
+            bp  = (int *)*sp++;
+            cpc = (char *)*sp++;
+        }
+        else if (op == LEA) {
+            ax = (int)(bp + decode());
+        }
+
+        // clang-format off
+        else if (op == OR) ax = *sp++ | ax;
+        else if (op == XOR) ax = *sp++ ^ ax;
+        else if (op == AND) ax = *sp++ & ax;
+        else if (op == EQ) ax = *sp++ == ax;
+        else if (op == NE) ax = *sp++ != ax;
+        else if (op == LT) ax = *sp++ < ax;
+        else if (op == LE) ax = *sp++ <= ax;
+        else if (op == GT) ax = *sp++ > ax;
+        else if (op == GE) ax = *sp++ >= ax;
+        else if (op == SHL) ax = *sp++ << ax;
+        else if (op == SHR) ax = *sp++ >> ax;
+        else if (op == ADD) ax = *sp++ + ax;
+        else if (op == SUB) ax = *sp++ - ax;
+        else if (op == MUL) ax = *sp++ * ax;
+        else if (op == DIV) ax = *sp++ / ax;
+        else if (op == MOD) ax = *sp++ % ax;
+        else if (op == ADDI) ax = ax + decode();
+        else if (op == SHLI) ax = ax << decode();
+        else if (op == SHRI) ax = ax >> decode();
+        else if (op == MULI) ax = ax * decode();
+        else if (op == DIVI) ax = ax / decode();
+        else if (op == DIVS) { a = decode(); ax = (ax < 0 ? ax + (1 << a) - 1 : ax) >> a; }
+        else if (op == MODI) ax = ax % decode();
+        // clang-format on
+
+        else if (op == EXIT) {
+            printf("exit(%d)", *sp);
+            return *sp;
+        }
+        else if (op >= OPEN && op <= MUNM) {
+            // PRTF needs the count of the following ADJ
+            save = cpc++;
+            a    = decode();
+            cpc  = save;
+            ax   = builtin(op, a);
+        }
+        else {
+            printf("unknown instruction: %d\n", op);
+            return -1;
+        }
+    }
+}
+
+// the syscall numbers perf needs differ between i386 and x86_64
+int perf_syscall(int nr32, int nr64)
+{
+    return sizeof(int) == 8 ? nr64 : nr32;
+}
+
+// perf_event_open() a counter of this process, disabled until perf_start()
+int perf_open(int type, int config)
+{
+    // type and size are 32-bit at 0 and 4, config 64-bit at 8, flags at 40
+    memset(perf_attr, 0, 128);
+    perf_attr[0]  = type;
+    perf_attr[4]  = 112;            // PERF_ATTR_SIZE_VER5
+    perf_attr[8]  = config;
+    perf_attr[10] = config >> 16;
+    perf_attr[40] = 1 + 32 + 64;    // disabled, exclude_kernel, exclude_hv
+    return syscall(perf_syscall(336, 298), perf_attr, 0, -1, -1, 0);
+}
+
+void perf_init()
+{
+    perf_fd[PERF_CYCLES]        = perf_open(0, 0);       // PERF_TYPE_HARDWARE
+    perf_fd[PERF_INSTRUCTIONS]  = perf_open(0, 1);
+    perf_fd[PERF_BRANCH_MISSES] = perf_open(0, 5);
+    perf_fd[PERF_L1I_MISSES]    = perf_open(3, 65537);   // PERF_TYPE_HW_CACHE, read miss
+    perf_fd[PERF_L1D_MISSES]    = perf_open(3, 65536);
+}
+
+// reset and enable every counter that could be opened
+void perf_start()
+{
+    int i;
+
+    i = 0;
+    while (i < PERF_EVENTS) {
+        if (perf_fd[i] >= 0) {
+            syscall(perf_syscall(54, 16), perf_fd[i], 9219, 0);   // PERF_EVENT_IOC_RESET
+            syscall(perf_syscall(54, 16), perf_fd[i], 9216, 0);   // PERF_EVENT_IOC_ENABLE
+        }
+        i++;
+    }
+}
+
+void perf_stop(int *counts)
+{
+    int i;
+
+    memset(counts, 0, PERF_EVENTS * 2 * sizeof(int));
+    i = 0;
+    while (i < PERF_EVENTS) {
+        if (perf_fd[i] >= 0) {
+            syscall(perf_syscall(54, 16), perf_fd[i], 9217, 0);   // PERF_EVENT_IOC_DISABLE
+            if (syscall(perf_syscall(3, 0), perf_fd[i], counts + i * 2, 8) != 8) {
+                perf_fd[i] = -1;
+            }
+        }
+        i++;
+    }
+}
+
+char *perf_name(int event)
+{
+    if (event == PERF_CYCLES) {
+        return "cycles";
+    }
+    if (event == PERF_INSTRUCTIONS) {
+        return "instructions";
+    }
+    if (event == PERF_BRANCH_MISSES) {
+        return "branch-misses";
+    }
+    if (event == PERF_L1I_MISSES) {
+        return "L1i-misses";
+    }
+    return "L1d-misses";
+}
+
+// print the count held in the 16-bit pieces a to d, most significant
+// first, dividing them by 10 one at a time so that no 64-bit value is needed
+void perf_print(int a, int b, int c, int d)
+{
+    int r;
+
+    r = a % 10;
+    a = a / 10;
+    r = r * 65536 + b;
+    b = r / 10;
+    r = r % 10 * 65536 + c;
+    c = r / 10;
+    r = r % 10 * 65536 + d;
+    d = r / 10;
+    if (a || b || c || d) {
+        perf_print(a, b, c, d);
+    }
+    printf("%c", '0' + r % 10);
+}
+
+void perf_report(char *phase, int *counts)
+{
+    int i, lo, hi;
+
+    printf("perf %s:", phase);
+    i = 0;
+    while (i < PERF_EVENTS) {
+        if (perf_fd[i] < 0) {
+            printf(" %s=n/a", perf_name(i));
+        }
+        else {
+            // the count is 64-bit, the low word first in a 32-bit build
+            lo = counts[i * 2];
+            hi = (sizeof(int) == 8) ? lo >> 16 >> 16 : counts[i * 2 + 1];
+            printf(" %s=", perf_name(i));
+            perf_print((hi >> 16) & 65535, hi & 65535, (lo >> 16) & 65535, lo & 65535);
+        }
+        i++;
+    }
+    printf("\n");
+}
+
+// print the name of the function entered at p, or its index
+void print_target(int *fn, int *p)
+{
+    int *id;
+
+    if (p >= old_text && p <= text && (id = (int *)fn[p - old_text])) {
+        printf("%.*s", name_length((char *)id[Name]), (char *)id[Name]);
+    }
+    else {
+        printf("L%d", p - old_text);
+    }
+}
+
+// the function entered at each text word, followed by whether a jump leads
+// to each text word, poolsize bytes each
+int *mark_code()
+{
+    int *fn, *label, *id, *p, *q;
+
+    if (!(fn = malloc(poolsize * 2))) {
+        printf("could not malloc(%d) for the code marks\n", poolsize * 2);
+        exit(-1);
+    }
+    label = (int *)((int)fn + poolsize);
+    memset(fn, 0, poolsize * 2);
+
+    id = symbols;
+    while (id < symbols_end) {
+        if (id[Class] == Fun && (int *)id[Value] > old_text && (int *)id[Value] <= text) {
+            fn[(int *)id[Value] - old_text] = (int)id;
+        }
+        id = id + IdSize;
+    }
+    p = old_text + 1;
+    while (p <= text) {
+        if ((q = jump_operand(p)) && (int *)*q > old_text && (int *)*q <= text) {
+            label[(int *)*q - old_text] = 1;
+        }
+        if (*p == JTAB || *p == JBIN) {
+            q = table_first(p);
+            while (q <= table_last(p)) {
+                label[(int *)*q - old_text] = 1;
+                q = q + table_step(p);
+            }
+        }
+        p = p + 1 + operands(*p);
+    }
+    return fn;
+}
+
+// the end of the function starting at p, fn as returned by mark_code()
+int *function_end(int *fn, int *p)
+{
+    p = p + 1 + operands(*p);
+    while (p <= text && !fn[p - old_text]) {
+        p = p + 1 + operands(*p);
+    }
+    return p;
+}
+
+// one `name calls words branches` line per function, then `count taken`
+// for each of its conditional branches in the order of the code
+int pgo_write()
+{
+    int  fd;
+    int *fn, *id, *p, *end, n;
+
+    if ((fd = open(pgo_file, 577, 420)) < 0) {   // O_WRONLY | O_CREAT | O_TRUNC, 0644
+        printf("could not open(%s)\n", pgo_file);
+        return -1;
+    }
+    fn = mark_code();
+    p  = old_text + 1;
+    while (p <= text) {
+        end = function_end(fn, p);
+        if ((id = (int *)fn[p - old_text])) {
+            n = 0;
+            while (p < end) {
+                n = n + is_branch(*p);
+                p = p + 1 + operands(*p);
+            }
+            p = (int *)id[Value];
+            dprintf(fd, "%.*s %d %d %d\n", name_length((char *)id[Name]), (char *)id[Name], pgo_count[p - old_text],
+                    end - p, n);
+            while (p < end) {
+                if (is_branch(*p)) {
+                    dprintf(fd, "%d %d\n", pgo_count[p - old_text], pgo_taken[p - old_text]);
+                }
+                p = p + 1 + operands(*p);
+            }
+        }
+        p = end;
+    }
+    close(fd);
+    return 0;
+}
+
+// read the numbers of a profile line, returns the next line
+char *pgo_numbers(char *s, int *numbers, int n)
+{
+    int neg;
+
+    while (n-- > 0) {
+        while (*s == ' ') {
+            s++;
+        }
+        neg = *s == '-';
+        s   = s + neg;
+        *numbers = 0;
+        while (*s >= '0' && *s <= '9') {
+            *numbers = *numbers * 10 + *s++ - '0';
+        }
+        *numbers = neg ? -*numbers : *numbers;
+        numbers++;
+    }
+    while (*s && *s++ != '\n') {
+    }
+    return s;
+}
+
+// the line of the function id in the profile, 0 if it is not profiled
+// or its code changed since; calls, words and branches go to info
+char *pgo_find(int *id, int *info, int *start, int *end)
+{
+    char *s, *name;
+    int   len;
+
+    s    = pgo_data;
+    name = (char *)id[Name];
+    len  = name_length(name);
+    while (*s) {
+        if (!memcmp(s, name, len) && s[len] == ' ') {
+            s = pgo_numbers(s + len, info, 3);
+            return (info[1] == end - start) ? s : 0;
+        }
+        s = pgo_numbers(s, info, 0);
+    }
+    return 0;
+}
+
+// move the most called functions to the start of text, keeping the order
+// of the code among functions called as often
+void pgo_layout()
+{
+    int *fn, *moved, *order, *id, *p, *q, *end, *copy;
+    int  n, i, j, best, delta, *info;
+
+    fn    = mark_code();
+    moved = (int *)((int)fn + poolsize);   // replaces the jump targets of mark_code()
+    info  = malloc(4 * sizeof(int));
+    order = malloc(poolsize);
+    copy  = malloc(poolsize);
+    if (!info || !order || !copy) {
+        printf("could not malloc(%d) for the profile layout\n", poolsize);
+        exit(-1);
+    }
+
+    // [start, end, calls] of each function in the order of the code
+    n = 0;
+    p = old_text + 1;
+    while (p <= text) {
+        end = function_end(fn, p);
+        order[n * 3]     = (int)p;
+        order[n * 3 + 1] = (int)end;
+        order[n * 3 + 2] = -1;
+        if (fn[p - old_text] && pgo_find((int *)fn[p - old_text], info, p, end)) {
+            order[n * 3 + 2] = info[0];
+        }
+        n++;
+        p = end;
+    }
+
+    // copy them hottest first, remember how far each one moved
+    q = copy;
+    i = 0;
+    while (i < n) {
+        best = -1;
+        j    = 0;
+        while (j < n) {
+            if (order[j * 3] && (best < 0 || order[j * 3 + 2] > order[best * 3 + 2])) {
+                best = j;
+            }
+            j++;
+        }
+        p     = (int *)order[best * 3];
+        end   = (int *)order[best * 3 + 1];
+        delta = (q - copy) - (p - (old_text + 1));
+        memcpy(q, p, (end - p) * sizeof(int));
+        while (p < end) {
+            moved[p - old_text] = delta;
+            p++;
+        }
+        q = q + (end - (int *)order[best * 3]);
+        order[best * 3] = 0;
+        i++;
+    }
+
+    // jumps and switch tables stay in their function, calls follow the callee
+    p = copy;
+    while (p < q) {
+        if ((end = jump_operand(p)) && (int *)*end > old_text && (int *)*end <= text) {
+            *end = (int)((int *)*end + moved[(int *)*end - old_text]);
+        }
+        if (*p == CALL && (int *)p[1] > old_text && (int *)p[1] <= text) {
+            p[1] = (int)((int *)p[1] + moved[(int *)p[1] - old_text]);
+        }
+        if (*p == JTAB || *p == JBIN) {
+            end = table_first(p);
+            while (end <= table_last(p)) {
+                *end = (int)((int *)*end + moved[(int *)*end - old_text]);
+                end  = end + table_step(p);
+            }
+        }
+        p = p + 1 + operands(*p);
+    }
+    id = symbols;
+    while (id < symbols_end) {
+        if (id[Class] == Fun && (int *)id[Value] > old_text && (int *)id[Value] <= text) {
+            id[Value] = (int)((int *)id[Value] + moved[(int *)id[Value] - old_text]);
+        }
+        id = id + IdSize;
+    }
+    if (line_of) {
+        memset(order, 0, poolsize);
+        p = old_text + 1;
+        while (p <= text) {
+            order[p + moved[p - old_text] - old_text] = line_of[p - old_text];
+            p++;
+        }
+        memcpy(line_of, order, (text - old_text + 1) * sizeof(int));
+    }
+    memcpy(old_text + 1, copy, (text - old_text) * sizeof(int));
+}
+
+// the source line of each statement, then its instructions with jump targets
+// as labels, then the size of each function and how often each opcode is used
+void disassemble()
+{
+    int  *fn,       // function entered at each text word
+         *label,    // whether a jump leads to each text word
+         *counts,   // uses of each opcode
+         *lines,    // start of each source line
+         *info,     // calls, words and branches of the function in the profile
+         *id, *p, *q, *f;
+    int   i, n, op, best, insns, last_line;
+    char *s,
+         *branches;   // profile of the next branch of the function, or 0
+
+    fn     = mark_code();
+    label  = (int *)((int)fn + poolsize);
+    counts = malloc((EXIT + 1) * sizeof(int));
+    lines  = malloc(poolsize);
+    info   = malloc(4 * sizeof(int));
+    if (!counts || !lines || !info) {
+        printf("could not malloc(%d) for the disassembly\n", poolsize);
+        exit(-1);
+    }
+    memset(counts, 0, (EXIT + 1) * sizeof(int));
+
+    n = 1;
+    s = old_src;
+    while (s < src_end && n < (int)(poolsize / sizeof(int)) - 1) {
+        if (*s++ == '\n') {
+            lines[++n] = (int)s;
+        }
+    }
+    lines[1]     = (int)old_src;
+    lines[n + 1] = (int)src_end;
+
+    // the code, function by function
+    last_line = 0;
+    branches  = 0;
+    p         = old_text + 1;
+    while (p <= text) {
+        if (fn[p - old_text]) {
+            id = (int *)fn[p - old_text];
+            printf("\n%.*s:", name_length((char *)id[Name]), (char *)id[Name]);
+            if (pgo_data && (branches = pgo_find(id, info, p, function_end(fn, p)))) {
+                printf("   ; %d calls", info[0]);
+            }
+            printf("\n");
+        }
+        if (label[p - old_text]) {
+            printf("L%d:\n", p - old_text);
+        }
+        if (line_of[p - old_text] && line_of[p - old_text] != last_line && line_of[p - old_text] <= n) {
+            last_line = line_of[p - old_text];
+            s         = (char *)lines[last_line];
+            i         = (char *)lines[last_line + 1] - s;
+            while (i > 0 && (s[i - 1] == '\n' || s[i - 1] == ' ')) {
+                i--;
+            }
+            while (i > 0 && *s == ' ') {
+                s++;
+                i--;
+            }
+            printf("    ; %d: %.*s\n", last_line, i, s);
         }
 
-        // mov + pop + ret
-        // LEV
-        else if (op == LEV) {
-            // leave current frame, restore call frame and pc
-            sp = bp;             // mov esp, ebp
-            bp = (int *)*sp++;   // pop ebp
-            pc = (int *)*sp++;   // ret
+        op = *p;
+        counts[op]++;
+        printf("%8d  %.5s ", p - old_text, op_name(op));
+        if ((q = jump_operand(p))) {
+            if (q == p + 2) {
+                printf("%d, ", p[1]);
+            }
+            printf("L%d", (int *)*q - old_text);
+        }
+        else if (op == CALL) {
+            print_target(fn, (int *)p[1]);
+        }
+        else if (op == LAZY || op == TICK) {
+            id = (int *)p[1];
+            printf("%.*s", name_length((char *)id[Name]), (char *)id[Name]);
+        }
+        else if (op == INCL) {
+            printf("%d, %d", p[1], p[2]);
+        }
+        else if (op == JTAB || op == JBIN) {
+            q = (int *)p[1];
+            printf("default L%d", (int *)*(table_first(p)) - old_text);
+            i = 0;
+            while (i < (op == JTAB ? q[1] - q[0] + 1 : q[0])) {
+                if (op == JTAB) {
+                    printf("\n                 %d: L%d", q[0] + i, (int *)q[3 + i] - old_text);
+                }
+                else {
+                    printf("\n                 %d: L%d", q[2 + i * 2], (int *)q[3 + i * 2] - old_text);
+                }
+                i++;
+            }
+        }
+        else if (op == IMM && p[1] >= (int)old_data && p[1] < (int)data) {
+            printf("data+%d", p[1] - (int)old_data);
         }
+        else if (operands(op)) {
+            printf("%d", p[1]);
+        }
+        if (branches && is_branch(op)) {
+            branches = pgo_numbers(branches, info, 2);
+            printf("   ; taken %d of %d", info[1], info[0]);
+        }
+        printf("\n");
+        p = p + 1 + operands(op);
+    }
 
-        // LEA <offset>
-        else if (op == LEA) {
-            // load address for argument
-            ax = (int)(bp + *pc++);
+    // instructions and words of each function, in the order of the code
+    printf("\n; function              instructions  words\n");
+    p = old_text + 1;
+    while (p <= text) {
+        f     = p;
+        insns = 0;
+        while (p <= text && (p == f || !fn[p - old_text])) {
+            insns++;
+            p = p + 1 + operands(*p);
+        }
+        if ((id = (int *)fn[f - old_text])) {
+            printf("; %-20.*s %12d %6d\n", name_length((char *)id[Name]), (char *)id[Name], insns, p - f);
         }
+        else {
+            printf("; %-20s %12d %6d\n", "(startup)", insns, p - f);
+        }
+    }
 
-        // operators
-        // clang-format off
-        else if (op == OR) ax = *sp++ | ax;
-        else if (op == XOR) ax = *sp++ ^ ax;
-        else if (op == AND) ax = *sp++ & ax;
-        else if (op == EQ) ax = *sp++ == ax;
-        else if (op == NE) ax = *sp++ != ax;
-        else if (op == LT) ax = *sp++ < ax;
-        else if (op == LE) ax = *sp++ <= ax;
-        else if (op == GT) ax = *sp++ > ax;
-        else if (op == GE) ax = *sp++ >= ax;
-        else if (op == SHL) ax = *sp++ << ax;
-        else if (op == SHR) ax = *sp++ >> ax;
-        else if (op == ADD) ax = *sp++ + ax;
-        else if (op == SUB) ax = *sp++ - ax;
-        else if (op == MUL) ax = *sp++ * ax;
-        else if (op == DIV) ax = *sp++ / ax;
-        else if (op == MOD) ax = *sp++ % ax;
-        // clang-format on
+    // opcodes by decreasing use
+    insns = 0;
+    i     = 0;
+    while (i <= EXIT) {
+        insns = insns + counts[i++];
+    }
+    printf("\n; opcode  count      %%\n");
+    while (1) {
+        best = 0;
+        i    = 1;
+        while (i <= EXIT) {
+            if (counts[i] > counts[best]) {
+                best = i;
+            }
+            i++;
+        }
+        if (!counts[best]) {
+            break;
+        }
+        printf("; %.5s %7d %6d\n", op_name(best), counts[best], counts[best] * 100 / insns);
+        counts[best] = 0;
+    }
 
-        // builtin function
-        else if (op == EXIT) {
-            printf("exit(%d)", *sp);
-            return *sp;
+    printf("\n; text %d words, data %d of %d bytes\n", text - old_text, data - old_data, poolsize);
+}
+
+// the C function of the interpreted function id
+void emit_c_name(int *id)
+{
+    printf("f_%.*s", name_length((char *)id[Name]), (char *)id[Name]);
+}
+
+// the host call of each builtin, with the arguments builtin() passes
+void emit_c_builtins()
+{
+    printf("static word xc_builtin(int op, word n, word *sp)\n{\n    word *t = sp + n;\n\n    switch (op) {\n");
+    printf("    case %d: return open((char *)t[-1], t[-2], t[-3]);\n", OPEN);
+    printf("    case %d: return read(sp[2], (char *)sp[1], sp[0]);\n", READ);
+    printf("    case %d: return close(*sp);\n", CLOS);
+    printf("    case %d: return printf((char *)t[-1], t[-2], t[-3], t[-4], t[-5], t[-6]);\n", PRTF);
+    printf("    case %d: return (word)malloc(*sp);\n", MALC);
+    printf("    case %d: return (word)memset((char *)sp[2], sp[1], sp[0]);\n", MSET);
+    printf("    case %d: return memcmp((char *)sp[2], (char *)sp[1], sp[0]);\n", MCMP);
+    printf("    case %d: return (word)memcpy((char *)sp[2], (char *)sp[1], sp[0]);\n", MCPY);
+    printf("    case %d: return (word)memmove((char *)sp[2], (char *)sp[1], sp[0]);\n", MMOV);
+    printf("    case %d: return strlen((char *)*sp);\n", SLEN);
+    printf("    case %d: return (word)memchr((char *)sp[2], sp[1], sp[0]);\n", MCHR);
+    printf("    case %d: return strcmp((char *)sp[1], (char *)sp[0]);\n", SCMP);
+    printf("    case %d: return syscall(t[-1], t[-2], t[-3], t[-4], t[-5], t[-6]);\n", SYSC);
+    printf("    case %d: return dprintf(t[-1], (char *)t[-2], t[-3], t[-4], t[-5], t[-6], t[-7]);\n", DPRF);
+    printf("    case %d: return clock_gettime(sp[1], (void *)sp[0]);\n", CLKT);
+    printf("    case %d: return write(sp[2], (char *)sp[1], sp[0]);\n", WRIT);
+    printf("    case %d: return (word)mmap((char *)sp[5], sp[4], sp[3], sp[2], sp[1], sp[0]);\n", MMAP);
+    printf("    default: return munmap((char *)sp[1], sp[0]);\n    }\n}\n\n");
+}
+
+// translate text into a C program (--emit-c): a C function for each function,
+// its frame on a stack array as in eval(), jumps as gotos
+void emit_c()
+{
+    int *fn, *label, *id, *p, *q;
+    int  op, i, in_function;
+
+    fn    = mark_code();
+    label = (int *)((int)fn + poolsize);
+
+    printf("#define _GNU_SOURCE\n#include <fcntl.h>\n#include <stdint.h>\n#include <stdio.h>\n#include <stdlib.h>\n");
+    printf("#include <string.h>\n#include <sys/mman.h>\n#include <time.h>\n#include <unistd.h>\n\n");
+    printf("typedef intptr_t  word;\ntypedef uintptr_t uword;\n\n");
+    printf("static word xc_stack[%d];\n", poolsize / sizeof(int));
+
+    // the data segment, the IMMs of its addresses are relocated below
+    printf("static char xc_data[%d] __attribute__((aligned(16))) = {", data - old_data + 1);
+    i = 0;
+    while (i < data - old_data) {
+        printf(i % 16 ? " %d," : "\n    %d,", old_data[i]);
+        i++;
+    }
+    printf("\n    0\n};\n\n");
+
+    id = symbols;
+    while (id < symbols_end) {
+        if (id[Class] == Fun && (int *)id[Value] > old_text) {
+            printf("static word ");
+            emit_c_name(id);
+            printf("(word *sp);\n");
+        }
+        id = id + IdSize;
+    }
+    printf("\n");
+    emit_c_builtins();
+
+    in_function = 0;
+    p           = old_text + 1;
+    while (p <= text) {
+        op = *p;
+        if (fn[p - old_text]) {
+            if (in_function) {
+                printf("}\n\n");
+            }
+            in_function = 1;
+            printf("static word ");
+            emit_c_name((int *)fn[p - old_text]);
+            printf("(word *sp)\n{\n    word ax = 0, *bp;\n\n    *--sp = 0;   // return address\n");
         }
-        else if (op == OPEN) {
-            ax = open((char *)sp[1], sp[0]);
+        if (label[p - old_text]) {
+            printf("L%d:;\n", p - old_text);
         }
-        else if (op == CLOS) {
-            ax = close(*sp);
+
+        if (!in_function) {
+            // no code is emitted outside of functions
         }
-        else if (op == READ) {
-            ax = read(sp[2], (char *)sp[1], *sp);
+        else if (op == LEA) {
+            printf("    ax = (word)(bp + %d);\n", p[1]);
         }
-        else if (op == PRTF) {
-            tmp = sp + pc[1];
-            ax  = printf((char *)tmp[-1], tmp[-2], tmp[-3], tmp[-4], tmp[-5], tmp[-6]);
+        else if (op == IMM && p[1] >= (int)old_data && p[1] <= (int)data) {
+            printf("    ax = (word)(xc_data + %d);\n", p[1] - (int)old_data);
         }
-        else if (op == MALC) {
-            ax = (int)malloc(*sp);
+        else if (op == IMM) {
+            printf("    ax = %d;\n", p[1]);
         }
-        else if (op == MSET) {
-            ax = (int)memset((char *)sp[2], sp[1], sp[0]);
+        else if (op == LL) {
+            printf("    ax = bp[%d];\n", p[1]);
         }
-        else if (op == MCMP) {
-            ax = memcmp((char *)sp[2], (char *)sp[1], sp[0]);
+        else if (op == SL) {
+            printf("    bp[%d] = ax;\n", p[1]);
         }
-
-        // others
-        else {
-            printf("unknown instruction: %d\n", op);
-            return -1;
+        else if (op == INCL) {
+            printf("    ax = bp[%d] = (word)((uword)bp[%d] + (uword)%d);\n", p[1], p[1], p[2]);
+        }
+        else if (op == JMP) {
+            printf("    goto L%d;\n", (int *)p[1] - old_text);
+        }
+        else if (op == JZ || op == JNZ) {
+            printf("    if (%sax) goto L%d;\n", op == JZ ? "!" : "", (int *)p[1] - old_text);
+        }
+        else if (op >= JEQ && op <= JGE) {
+            // J<cc> leaves ax 0 on the jump, 1 otherwise
+            printf("    ax = *sp++ %.2s ax;\n    if (!ax) goto L%d;\n", "!===>=<=> < " + (op - JEQ) * 2,
+                   (int *)p[1] - old_text);
+        }
+        else if (op >= JEQI && op <= JGEI) {
+            printf("    ax = ax %.2s %d;\n    if (!ax) goto L%d;\n", "!===>=<=> < " + (op - JEQI) * 2, p[1],
+                   (int *)p[2] - old_text);
+        }
+        else if (op == JTAB || op == JBIN) {
+            q = (int *)p[1];
+            printf("    switch (ax) {\n");
+            i = 0;
+            while (i < (op == JTAB ? q[1] - q[0] + 1 : q[0])) {
+                if (op == JTAB) {
+                    printf("    case %d: goto L%d;\n", q[0] + i, (int *)q[3 + i] - old_text);
+                }
+                else {
+                    printf("    case %d: goto L%d;\n", q[2 + i * 2], (int *)q[3 + i * 2] - old_text);
+                }
+                i++;
+            }
+            printf("    default: goto L%d;\n    }\n", (int *)*(table_first(p)) - old_text);
+        }
+        else if (op == CALL) {
+            printf("    ax = ");
+            emit_c_name((int *)fn[(int *)p[1] - old_text]);
+            printf("(sp);\n");
+        }
+        else if (op == ENT) {
+            printf("    *--sp = 0;\n    bp = sp;\n    sp = sp - %d;\n", p[1]);
+        }
+        else if (op == ADJ) {
+            printf("    sp = sp + %d;\n", p[1]);
+        }
+        else if (op == LEV) {
+            printf("    return ax;\n");
+        }
+        else if (op == LI) {
+            printf("    ax = *(word *)ax;\n");
+        }
+        else if (op == LC) {
+            printf("    ax = *(char *)ax;\n");
+        }
+        else if (op == SI) {
+            printf("    *(word *)*sp++ = ax;\n");
+        }
+        else if (op == SC) {
+            printf("    ax = *(char *)*sp++ = ax;\n");
+        }
+        else if (op == LIX) {
+            printf("    ax = *((word *)*sp++ + ax);\n");
+        }
+        else if (op == LCX) {
+            printf("    ax = *((char *)*sp++ + ax);\n");
+        }
+        else if (op == SIX) {
+            printf("    *((word *)sp[1] + *sp) = ax;\n    sp = sp + 2;\n");
+        }
+        else if (op == SCX) {
+            printf("    ax = *((char *)sp[1] + *sp) = ax;\n    sp = sp + 2;\n");
+        }
+        else if (op == IXA) {
+            printf("    ax = (word)((word *)*sp++ + ax);\n");
+        }
+        else if (op == PUSH) {
+            printf("    *--sp = ax;\n");
         }
+        else if (op == ADD || op == SUB || op == MUL || op == SHL) {
+            // wrap around like the interpreter instead of overflowing
+            printf("    ax = (word)((uword)*sp++ %.2s (uword)ax);\n", "| ^ & ==!=< > <=>=<<>>+ - * / % " + (op - OR) * 2);
+        }
+        else if (op >= OR && op <= MOD) {
+            printf("    ax = *sp++ %.2s ax;\n", "| ^ & ==!=< > <=>=<<>>+ - * / % " + (op - OR) * 2);
+        }
+        else if (op == ADDI || op == MULI) {
+            printf("    ax = (word)((uword)ax %s (uword)%d);\n", op == ADDI ? "+" : "*", p[1]);
+        }
+        else if (op == SHLI) {
+            printf("    ax = (word)((uword)ax << %d);\n", p[1]);
+        }
+        else if (op == SHRI || op == DIVI || op == MODI) {
+            printf("    ax = ax %s %d;\n", op == SHRI ? ">>" : (op == DIVI ? "/" : "%"), p[1]);
+        }
+        else if (op == DIVS) {
+            printf("    ax = (ax < 0 ? ax + ((word)1 << %d) - 1 : ax) >> %d;\n", p[1], p[1]);
+        }
+        else if (op == EXIT) {
+            printf("    printf(%cexit(%%d)%c, (int)*sp);\n    exit(*sp);\n", 34, 34);
+        }
+        else if (op >= OPEN && op <= MUNM) {
+            printf("    ax = xc_builtin(%d, %d, sp);\n", op, p[1] == ADJ ? p[2] : 0);
+        }
+        // LAZY never remains in a compiled function, TICK and TICKL only count
+        p = p + 1 + operands(op);
+    }
+    if (in_function) {
+        printf("}\n\n");
+    }
+
+    printf("int main(int argc, char **argv)\n{\n    word *sp = xc_stack + %d, ax;\n\n", poolsize / sizeof(int));
+    printf("    if (sizeof(word) != %d) {\n", sizeof(int));
+    printf("        printf(%ccompile with %d-byte pointers like the xc that wrote this file%cn%c);\n", 34, sizeof(int), 92, 34);
+    printf("        return 1;\n    }\n    *--sp = argc;\n    *--sp = (word)argv;\n    ax = ");
+    emit_c_name(idmain);
+    printf("(sp);\n    printf(%cexit(%%d)%c, (int)ax);\n    return ax;\n}\n", 34, 34);
+}
+
+// microseconds of CLOCK_MONOTONIC since the first call
+int stats_now()
+{
+    if (!stats) {
+        return 0;
+    }
+    clock_gettime(1, (void *)stats_clock);
+    if (!stats_base) {
+        stats_base = stats_clock[0];
     }
+    return (stats_clock[0] - stats_base) * 1000000 + stats_clock[1] / 1000;
+}
+
+// the stack is zeroed before the run, so its lowest nonzero word is about
+// the lowest sp seen
+int stats_stack_used()
+{
+    int *p;
+
+    p = stack;
+    while (p < (int *)((int)stack + poolsize) && !*p) {
+        p++;
+    }
+    return (int)stack + poolsize - (int)p;
+}
+
+void stats_report(int keywords_us, int load_us, int compile_us, int run_us)
+{
+    printf("\nstats.keywords_us=%d\nstats.load_us=%d\nstats.compile_us=%d\nstats.run_us=%d\n", keywords_us, load_us,
+           compile_us, run_us);
+    printf("stats.tokens=%d\nstats.tokens_per_sec=%d\n", tokens,
+           compile_us ? (tokens / compile_us) * 1000000 + (tokens % compile_us) * 1000000 / compile_us : 0);
+    printf("stats.pool_bytes=%d\nstats.text_bytes=%d\nstats.data_bytes=%d\n", poolsize, (text - old_text) * sizeof(int),
+           data - old_data);
+    printf("stats.stack_bytes=%d\nstats.symbols_bytes=%d\n", stats_stack_used(), (symbols_end - symbols) * sizeof(int));
 }
 
 int main(int argc, char **argv)
 {
     int  i, fd;
     int *tmp;
+    int  t_start, t_keywords, t_load, t_compile;
     argc--;
     argv++;
 
+    // parse options
+    while (argc > 0 && **argv == '-') {
+        if (!strcmp(*argv, "--lazy")) {
+            lazy = 1;
+        }
+        else if (!strcmp(*argv, "-O2")) {
+            opt_level = 2;
+        }
+        else if (!strcmp(*argv, "--tiered")) {
+            tiered = 1;
+        }
+        else if (!strcmp(*argv, "--compact")) {
+            compact = 1;
+        }
+        else if (!strcmp(*argv, "--sizes")) {
+            compact = 2;   // only report the size of both encodings
+        }
+        else if (!strcmp(*argv, "--perf-counters")) {
+            perf_counters = 1;
+        }
+        else if (!strcmp(*argv, "--trace") && argc > 1) {
+            trace = 1;
+            argc--;
+            argv++;
+            trace_file = *argv;
+        }
+        else if (!strcmp(*argv, "--trace-decode") && argc > 1) {
+            return trace_decode(argv[1]);
+        }
+        else if (!strcmp(*argv, "-S")) {
+            disasm = 1;
+        }
+        else if (!strcmp(*argv, "--emit-c")) {
+            disasm = 2;   // the same whole program, printed as C
+        }
+        else if (!strcmp(*argv, "--stats")) {
+            stats = 1;
+        }
+        else if (!strcmp(*argv, "--profile") && argc > 1) {
+            profile = 1;
+            argc--;
+            argv++;
+            prof_file = *argv;
+        }
+        else if (!strcmp(*argv, "--write-profile") && argc > 1) {
+            pgo = 1;
+            argc--;
+            argv++;
+            pgo_file = *argv;
+        }
+        else if (!strcmp(*argv, "--use-profile") && argc > 1) {
+            pgo = 2;
+            argc--;
+            argv++;
+            pgo_file = *argv;
+        }
+        else {
+            printf("unknown option: %s\n", *argv);
+            return -1;
+        }
+        argc--;
+        argv++;
+    }
+    if (argc < 1) {
+        printf("usage: xc [-S] [--emit-c] [--lazy] [-O2] [--tiered] [--compact] [--sizes] [--perf-counters] [--profile file] [--trace file] [--stats]\n          [--write-profile file | --use-profile file] file ...\n       xc --trace-decode file\n");
+        return -1;
+    }
+    if (compact && (lazy || tiered)) {
+        printf("--compact and --sizes need the whole program compiled before it runs\n");
+        return -1;
+    }
+    if (compact && (profile || trace)) {
+        printf("--profile and --trace do not follow the byte encoding of --compact\n");
+        return -1;
+    }
+    if (disasm && lazy) {
+        printf("-S and --emit-c need the whole program compiled, not --lazy\n");
+        return -1;
+    }
+    if (profile && trace) {
+        printf("--profile and --trace can not be used together\n");
+        return -1;
+    }
+    if (pgo == 1 && (lazy || tiered || compact || profile || trace)) {
+        printf("--write-profile counts the plain interpreter, without --lazy, --tiered, --compact, --profile or --trace\n");
+        return -1;
+    }
+    if (pgo == 2 && lazy) {
+        printf("--use-profile needs the whole program compiled, not --lazy\n");
+        return -1;
+    }
+
     poolsize = 256 * 1024;
     line     = 1;
 
@@ -1361,7 +4616,7 @@ int main(int argc, char **argv)
         printf("could not malloc(%d) for text area", poolsize);
         return -1;
     }
-    if (!(data = malloc(poolsize))) {
+    if (!(data = old_data = malloc(poolsize))) {
         printf("could not malloc(%d) for data area", poolsize);
         return -1;
     }
@@ -1373,39 +4628,94 @@ int main(int argc, char **argv)
         printf("could not malloc(%d) for symbols table", poolsize);
         return -1;
     }
+    if (!(buckets = malloc(SYMBOL_BUCKETS * sizeof(int)))) {
+        printf("could not malloc(%d) for symbol hash", SYMBOL_BUCKETS * sizeof(int));
+        return -1;
+    }
+    if (!(locals = malloc(poolsize))) {
+        printf("could not malloc(%d) for local variables", poolsize);
+        return -1;
+    }
+    if (!(keywords = malloc(KEYWORD_SLOTS * KwSize * sizeof(int)))) {
+        printf("could not malloc(%d) for keyword table", KEYWORD_SLOTS * KwSize * sizeof(int));
+        return -1;
+    }
+    if (!(char_class = malloc(256))) {
+        printf("could not malloc(%d) for character classes", 256);
+        return -1;
+    }
+    if (!(cases = malloc(poolsize))) {
+        printf("could not malloc(%d) for case labels", poolsize);
+        return -1;
+    }
+    case_end = cases;
+    if (compact && (!(code = malloc(poolsize)) || !(code_pos = malloc(poolsize + sizeof(int)))
+                    || !(code_size = malloc(poolsize + sizeof(int))))) {
+        printf("could not malloc(%d) for the byte encoding", poolsize);
+        return -1;
+    }
+    if ((opt_level || tiered) && (!(opt_flags = malloc(poolsize + sizeof(int))) || !(opt_pos = malloc(poolsize + sizeof(int))))) {
+        printf("could not malloc(%d) for the optimizer", poolsize + sizeof(int));
+        return -1;
+    }
+    if (perf_counters && (!(perf_fd = malloc(PERF_EVENTS * 5 * sizeof(int))) || !(perf_attr = malloc(128)))) {
+        printf("could not malloc(%d) for perf counters", PERF_EVENTS * 5 * sizeof(int));
+        return -1;
+    }
+    if (disasm && !(line_of = malloc(poolsize))) {
+        printf("could not malloc(%d) for the line table", poolsize);
+        return -1;
+    }
+    if (disasm) {
+        memset(line_of, 0, poolsize);
+    }
+    if (stats && !(stats_clock = malloc(2 * sizeof(int)))) {
+        printf("could not malloc(%d) for the clock", 2 * sizeof(int));
+        return -1;
+    }
+    if (profile && (!(prof_func = malloc(poolsize)) || !(prof_stacks = malloc(poolsize))
+                    || !(prof_buckets = malloc(PROF_BUCKETS * sizeof(int))))) {
+        printf("could not malloc(%d) for the profile", poolsize);
+        return -1;
+    }
+    if (profile) {
+        memset(prof_func, 0, poolsize);
+        memset(prof_buckets, 0, PROF_BUCKETS * sizeof(int));
+        prof_end  = prof_stacks;
+        prof_left = PROF_PERIOD;
+    }
+    if (pgo == 1 && (!(pgo_count = malloc(poolsize)) || !(pgo_taken = malloc(poolsize)))) {
+        printf("could not malloc(%d) for the profile counts", poolsize);
+        return -1;
+    }
+    if (pgo == 1) {
+        memset(pgo_count, 0, poolsize);
+        memset(pgo_taken, 0, poolsize);
+    }
+    stack_top = (int *)((int)stack + poolsize);
+    if (!(fd_buf = malloc(FD_MAX * 3 * sizeof(int)))) {
+        printf("could not malloc(%d) for read buffers", FD_MAX * 3 * sizeof(int));
+        return -1;
+    }
     memset(text, 0, poolsize);
     memset(data, 0, poolsize);
     memset(stack, 0, poolsize);
+    memset(symbols, 0, poolsize);
+    memset(buckets, 0, SYMBOL_BUCKETS * sizeof(int));
+    symbols_end = symbols;
+    memset(keywords, 0, KEYWORD_SLOTS * KwSize * sizeof(int));
+    memset(fd_buf, 0, FD_MAX * 3 * sizeof(int));
+    fd_pos = fd_buf + FD_MAX;
+    fd_end = fd_pos + FD_MAX;
+    init_char_class();
 
     // initialization registers
     bp = sp = (int *)((int)stack + poolsize);
     ax      = 0;
 
-    // add keywords to symbol table
-    src = "char else enum if int return sizeof while "
-          "open read close printf malloc memset memcmp exit "
-          "void main";
-
-    // add keywords to symbol table
-    i = Char;
-    while (i <= While) {
-        next();
-        current_id[Token] = i++;
-    }
-
-    // add library to symbol table
-    i = OPEN;
-    while (i <= EXIT) {
-        next();
-        current_id[Class] = Sys;
-        current_id[Type]  = INT;
-        current_id[Value] = i++;
-    }
-
-    // clang-format off
-    next(); current_id[Token] = Char;   // handle void type
-    next(); idmain = current_id;        // keep track of main
-    // clang-format on
+    t_start = stats_now();
+    init_keywords();
+    t_keywords = stats_now();
 
     // open and read source file
     if ((fd = open(*argv, 0)) < 0) {
@@ -1420,10 +4730,50 @@ int main(int argc, char **argv)
         printf("read() return %d\n", i);
         return -1;
     }
-    src[i] = 0;   // add EOF character
+    src[i]  = 0;   // add EOF character
+    src_end = src + i;
     close(fd);
+    if (pgo == 2) {
+        if ((fd = open(pgo_file, 0)) < 0) {
+            printf("could not open(%s)\n", pgo_file);
+            return -1;
+        }
+        if (!(pgo_data = malloc(poolsize))) {
+            printf("could not malloc(%d) for the profile\n", poolsize);
+            return -1;
+        }
+        if ((i = read(fd, pgo_data, poolsize - 1)) < 0) {
+            printf("read() return %d\n", i);
+            return -1;
+        }
+        pgo_data[i] = 0;
+        close(fd);
+    }
+    t_load = stats_now();
 
+    if (perf_counters) {
+        perf_compile = perf_fd + PERF_EVENTS;
+        perf_run     = perf_compile + PERF_EVENTS * 2;
+        perf_init();
+        perf_start();
+    }
+    tokens = 0;
     program();
+    if (perf_counters) {
+        perf_stop(perf_compile);
+    }
+    if (pgo == 2) {
+        pgo_layout();
+    }
+    t_compile = stats_now();
+    if (disasm == 1) {
+        disassemble();
+        return 0;
+    }
+    if (disasm == 2) {
+        emit_c();
+        return 0;
+    }
 
     if (!(pc = (int *)idmain[Value])) {
         printf("main() not defined\n");
@@ -1432,13 +4782,69 @@ int main(int argc, char **argv)
 
     sp    = (int *)((int)stack + poolsize);
 
-    // when leave main function, pc point to sp through LEV command
-    *--sp = EXIT;   // call exit if main returns
-    *--sp = PUSH;
-    tmp   = sp;
+    // when leave main function, pc point to the last words of the text
+    // pool through LEV command, past the code compiled while running
+    tmp    = (int *)((int)old_text + poolsize) - 2;
+    tmp[0] = PUSH;
+    tmp[1] = EXIT;   // call exit if main returns
+
+    if (compact) {
+        i = encode_program();
+        if (compact == 2) {
+            printf("text %d bytes, compact %d bytes (%d%%)\n", (text - old_text) * sizeof(int), i,
+                   i * 100 / ((text - old_text) * sizeof(int)));
+            return 0;
+        }
+        code[i]     = PUSH;
+        code[i + 1] = EXIT;
+        tmp         = (int *)(code + i);
+        cpc         = code + code_pos[pc - (old_text + 1)];
+    }
     *--sp = argc;
     *--sp = (int)argv;
     *--sp = (int)tmp;
 
-    return eval();
+    if (perf_counters) {
+        perf_start();
+    }
+    t_compile = stats_now() - t_compile + (t_compile - t_load);   // encode_program() counts as compiling
+    t_load    = t_load - t_keywords;
+    if (trace) {
+        if (trace_open() < 0) {
+            return -1;
+        }
+    }
+    if (trace || pgo == 1) {
+        if (!(hook_shadow = malloc(poolsize))) {
+            printf("could not malloc(%d) for the hooks\n", poolsize);
+            return -1;
+        }
+        hook_patch(old_text + 1, text);
+        hook_patch(tmp, tmp + 1);
+        hook_end = text;
+    }
+    fd        = stats_now();
+    i         = compact ? eval_compact() : eval();
+    if (hook_end) {
+        hook_unpatch();
+    }
+    if (trace) {
+        trace_close(i);
+    }
+    if (stats) {
+        stats_report(t_keywords - t_start, t_load, t_compile, stats_now() - fd);
+    }
+    if (perf_counters) {
+        perf_stop(perf_run);
+        printf("\n");
+        perf_report("compile", perf_compile);
+        perf_report("run", perf_run);
+    }
+    if (profile && prof_write() < 0) {
+        return -1;
+    }
+    if (pgo == 1 && pgo_write() < 0) {
+        return -1;
+    }
+    return i;
 }